@@ -21,16 +21,72 @@
 #include <devicetree.h>
 
 #include <logging/log.h>
+#if CONFIG_HC_SR04_HW_CAPTURE
+#include <nrfx_timer.h>
+#include <nrfx_ppi.h>
+#include <hal/nrf_gpiote.h>
+#endif
+#if CONFIG_HC_SR04_FAST_TRIG
+#include <hal/nrf_gpio.h>
+#endif
+#if CONFIG_HC_SR04_STATS
+#include <stats/stats.h>
+#include <shell/shell.h>
+#endif
+
+#include "hc_sr04_calc.h"
 
 LOG_MODULE_REGISTER(hc_sr04, CONFIG_HC_SR04_LOG_LEVEL);
 
 /* Timings defined by spec */
-#define T_TRIG_PULSE_US       11
-#define T_INVALID_PULSE_US    25000
 #define T_MAX_WAIT_MS         130
 #define T_SPURIOS_WAIT_US     145
+#define T_SETTLE_US           (2 * T_SPURIOS_WAIT_US) /* Until the spurious pulse has ended */
 #define METERS_PER_SEC        340
 
+/* Speed of sound in air is 331.3m/s at 0C and rises by 0.606m/s per degree */
+#define SOUND_MM_PER_SEC_0C   331300
+#define SOUND_MM_PER_SEC_PER_C 606
+#define SOUND_MM_PER_SEC_MIN  300000
+#define SOUND_MM_PER_SEC_MAX  400000
+#define AMBIENT_MC_MIN        (-40000)
+#define AMBIENT_MC_MAX        85000
+
+#if CONFIG_HC_SR04_HW_CAPTURE
+#define CAPTURE_RISE_CHAN     NRF_TIMER_CC_CHANNEL0
+#define CAPTURE_FALL_CHAN     NRF_TIMER_CC_CHANNEL1
+#endif
+
+#if CONFIG_HC_SR04_STATS
+STATS_SECT_START(hc_sr04)
+STATS_SECT_ENTRY32(fetches)
+STATS_SECT_ENTRY32(valid)
+STATS_SECT_ENTRY32(invalid)
+STATS_SECT_ENTRY32(timeouts)
+STATS_SECT_ENTRY32(gpio_errors)
+STATS_SECT_ENTRY32(lock_wait_us) /* Total time spent waiting for other devices */
+STATS_SECT_ENTRY32(lock_wait_max_us)
+STATS_SECT_ENTRY32(last_echo_us)
+STATS_SECT_END;
+
+STATS_NAME_START(hc_sr04)
+STATS_NAME(hc_sr04, fetches)
+STATS_NAME(hc_sr04, valid)
+STATS_NAME(hc_sr04, invalid)
+STATS_NAME(hc_sr04, timeouts)
+STATS_NAME(hc_sr04, gpio_errors)
+STATS_NAME(hc_sr04, lock_wait_us)
+STATS_NAME(hc_sr04, lock_wait_max_us)
+STATS_NAME(hc_sr04, last_echo_us)
+STATS_NAME_END(hc_sr04);
+
+#define DATA_STATS_INC(p_data, var)        STATS_INC((p_data)->stats, var)
+#define DATA_STATS_SET(p_data, var, value) ((p_data)->stats.var = (value))
+#else
+#define DATA_STATS_INC(p_data, var)
+#define DATA_STATS_SET(p_data, var, value)
+#endif
+
 enum hc_sr04_state {
     HC_SR04_STATE_IDLE,
     HC_SR04_STATE_RISING_EDGE,
@@ -41,19 +97,58 @@ enum hc_sr04_state {
 };
 
 static struct hc_sr04_shared_resources {
-    struct k_sem         fetch_sem;
-    struct k_mutex       mutex;
-    bool                 ready; /* The module has been initialized */
-    enum hc_sr04_state   state;
-    uint32_t             start_time;
-    uint32_t             end_time;
+#if !CONFIG_HC_SR04_CONCURRENT
+    struct k_sem         lock_sem; /* Held for the duration of a measurement */
+#endif
+#if CONFIG_HC_SR04_HW_CAPTURE
+    nrf_ppi_channel_t    rise_channel; /* Echo GPIOTE event -> CAPTURE_RISE_CHAN, first edge only */
+    nrf_ppi_channel_t    fall_channel; /* Echo GPIOTE event -> CAPTURE_FALL_CHAN, every edge */
+    nrf_ppi_channel_group_t rise_group; /* Disabled by the first edge */
+#endif
+    bool                 ready; /* The shared resources have been initialized */
 } m_shared_resources;
 
+#if CONFIG_HC_SR04_HW_CAPTURE
+static const nrfx_timer_t m_capture_timer = NRFX_TIMER_INSTANCE(CONFIG_HC_SR04_HW_CAPTURE_TIMER);
+
+#if CONFIG_HC_SR04_NRFX
+BUILD_ASSERT(CONFIG_HC_SR04_HW_CAPTURE_TIMER != CONFIG_HC_SR04_NRFX_TIMER,
+             "hc-sr04: CONFIG_HC_SR04_HW_CAPTURE_TIMER is already used by HC_SR04_NRFX");
+#endif
+#endif
+
 struct hc_sr04_data {
-    struct sensor_value   sensor_value;
-    const struct device  *trig_dev;
-    const struct device  *echo_dev;
-    struct gpio_callback  echo_cb_data;
+    struct sensor_value      sensor_value;
+    uint32_t                 scale; /* Echo microseconds to micrometers, see SCALE_SHIFT */
+    struct hc_sr04_timestamps timestamps; /* Of sensor_value */
+#if CONFIG_HC_SR04_STATS
+    STATS_SECT_DECL(hc_sr04) stats;
+#endif
+    const struct device     *trig_dev;
+    const struct device     *echo_dev;
+    struct gpio_callback     echo_cb_data;
+    struct k_sem             fetch_sem;
+#if CONFIG_HC_SR04_CONCURRENT
+    struct k_sem             lock_sem; /* Held for the duration of a measurement */
+#endif
+    enum hc_sr04_state       state;
+    bool                     async; /* Completion is handled by the work queue */
+    bool                     ready; /* The device has been initialized */
+    bool                     settling; /* An invalid echo's spurious pulse may still follow */
+    uint32_t                 settle_time; /* k_cycle_get_32() when that pulse has passed */
+    uint32_t                 trigger_time;
+    uint32_t                 start_time; /* See edge_time_get() */
+    uint32_t                 end_time;
+#if CONFIG_HC_SR04_TRIGGER
+    const struct device     *dev;
+    struct k_delayed_work    work;
+    sensor_trigger_handler_t data_ready_handler;
+    struct sensor_trigger    data_ready_trigger;
+    k_tid_t                  data_ready_thread; /* Running data_ready_handler */
+#endif
+#if CONFIG_HC_SR04_FETCH_ASYNC
+    struct k_poll_signal    *p_signal; /* Raised when the pending measurement completes */
+#endif
 };
 
 struct hc_sr04_cfg {
@@ -63,28 +158,179 @@ struct hc_sr04_cfg {
     const char * const   echo_port;
     const uint8_t        echo_pin;
     const uint32_t       echo_flags;
+#if CONFIG_HC_SR04_HW_CAPTURE
+    const uint32_t       echo_abs_pin; /* Pin number including the port */
+#endif
+#if CONFIG_HC_SR04_FAST_TRIG
+    void (* const        trig_pulse)(void); /* See TRIG_PULSE_DEFINE() */
+#endif
 };
 
+#if CONFIG_HC_SR04_FAST_TRIG
+/* Inlined into a function per instance with the port, mask and polarity as constants. */
+static ALWAYS_INLINE void trig_pulse(NRF_GPIO_Type *p_port, uint32_t mask, bool active_low)
+{
+    if (active_low) {
+        nrf_gpio_port_out_clear(p_port, mask);
+        k_busy_wait(T_TRIG_PULSE_US);
+        nrf_gpio_port_out_set(p_port, mask);
+    } else {
+        nrf_gpio_port_out_set(p_port, mask);
+        k_busy_wait(T_TRIG_PULSE_US);
+        nrf_gpio_port_out_clear(p_port, mask);
+    }
+}
+#endif
+
+/*
+ * Microseconds since TRIG from the edge's own TIMER capture made by PPI, or
+ * the cycle counter when the interrupt is serviced.
+ */
+#if CONFIG_HC_SR04_HW_CAPTURE
+#define EDGE_TIME_GET(chan)   nrfx_timer_capture_get(&m_capture_timer, (chan))
+#else
+#define EDGE_TIME_GET(chan)   k_cycle_get_32()
+#endif
+
+static inline struct k_sem *lock_get(struct hc_sr04_data *p_data)
+{
+#if CONFIG_HC_SR04_CONCURRENT
+    return &p_data->lock_sem;
+#else
+    ARG_UNUSED(p_data);
+    return &m_shared_resources.lock_sem;
+#endif
+}
+
+static void echo_finished(const struct device *dev,
+                          struct gpio_callback *cb,
+                          struct hc_sr04_data *p_data)
+{
+    (void) gpio_remove_callback(dev, cb);
+    p_data->state = HC_SR04_STATE_FINISHED;
+    k_sem_give(&p_data->fetch_sem);
+#if CONFIG_HC_SR04_TRIGGER
+    if (p_data->async) {
+        (void) k_delayed_work_submit(&p_data->work, K_NO_WAIT);
+    }
+#endif
+}
+
 static void input_changed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
-    switch (m_shared_resources.state) {
+    struct hc_sr04_data *p_data = CONTAINER_OF(cb, struct hc_sr04_data, echo_cb_data);
+
+    switch (p_data->state) {
     case HC_SR04_STATE_RISING_EDGE:
-        m_shared_resources.start_time = k_cycle_get_32();
-        m_shared_resources.state = HC_SR04_STATE_FALLING_EDGE;
+        p_data->start_time = EDGE_TIME_GET(CAPTURE_RISE_CHAN);
+#if CONFIG_HC_SR04_HW_CAPTURE
+        /*
+         * Both channels capture the rising edge. If the falling one has
+         * already moved on, this interrupt came late enough to cover both
+         * edges and there won't be another one.
+         */
+        p_data->end_time = EDGE_TIME_GET(CAPTURE_FALL_CHAN);
+        if (p_data->end_time != p_data->start_time) {
+            echo_finished(dev, cb, p_data);
+            break;
+        }
+#endif
+        p_data->state = HC_SR04_STATE_FALLING_EDGE;
         break;
     case HC_SR04_STATE_FALLING_EDGE:
-        m_shared_resources.end_time = k_cycle_get_32();
-        (void) gpio_remove_callback(dev, cb);
-        m_shared_resources.state = HC_SR04_STATE_FINISHED;
-        k_sem_give(&m_shared_resources.fetch_sem);
+        p_data->end_time = EDGE_TIME_GET(CAPTURE_FALL_CHAN);
+        echo_finished(dev, cb, p_data);
         break;
     default:
         (void) gpio_remove_callback(dev, cb);
-        m_shared_resources.state = HC_SR04_STATE_ERROR;
+        p_data->state = HC_SR04_STATE_ERROR;
         break;
     }
 }
 
+#if CONFIG_HC_SR04_TRIGGER
+static void trigger_work_handler(struct k_work *work);
+#endif
+
+#if CONFIG_HC_SR04_HW_CAPTURE
+static void timer_handler(nrf_timer_event_t event_type, void * p_context)
+{
+    /* Required by the NRFX driver but never called, no compare interrupt is enabled. */
+}
+
+static int capture_init(void)
+{
+    nrfx_err_t nrfx_err;
+
+    nrfx_timer_config_t cfg = NRFX_TIMER_DEFAULT_CONFIG;
+    cfg.bit_width           = NRF_TIMER_BIT_WIDTH_32;
+    cfg.frequency           = NRF_TIMER_FREQ_1MHz;
+
+    nrfx_err = nrfx_timer_init(&m_capture_timer, &cfg, timer_handler);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return -EBUSY;
+    }
+    nrfx_err = nrfx_ppi_channel_alloc(&m_shared_resources.rise_channel);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return -ENOMEM;
+    }
+    nrfx_err = nrfx_ppi_channel_alloc(&m_shared_resources.fall_channel);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return -ENOMEM;
+    }
+    nrfx_err = nrfx_ppi_group_alloc(&m_shared_resources.rise_group);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return -ENOMEM;
+    }
+
+    /*
+     * The event endpoints are set to the measured device's echo pin on every fetch.
+     *
+     * Echo event -> Capture CAPTURE_RISE_CHAN  (rise_group)
+     *            -> Disable rise_group
+     * Echo event -> Capture CAPTURE_FALL_CHAN
+     */
+    nrf_ppi_task_endpoint_setup(NRF_PPI,
+        m_shared_resources.rise_channel,
+        nrfx_timer_capture_task_address_get(&m_capture_timer, CAPTURE_RISE_CHAN));
+    nrfx_err = nrfx_ppi_channel_fork_assign(m_shared_resources.rise_channel,
+        nrfx_ppi_task_addr_group_disable_get(m_shared_resources.rise_group));
+    if (NRFX_SUCCESS != nrfx_err) {
+        return -EIO;
+    }
+    nrfx_err = nrfx_ppi_channel_include_in_group(m_shared_resources.rise_channel,
+                                                 m_shared_resources.rise_group);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return -EIO;
+    }
+    nrf_ppi_task_endpoint_setup(NRF_PPI,
+        m_shared_resources.fall_channel,
+        nrfx_timer_capture_task_address_get(&m_capture_timer, CAPTURE_FALL_CHAN));
+    nrfx_err = nrfx_ppi_channel_enable(m_shared_resources.fall_channel);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return -EIO;
+    }
+    return 0;
+}
+
+static int capture_event_find(uint32_t abs_pin, uint32_t *p_event_addr)
+{
+    uint32_t ch;
+    uint32_t mode;
+
+    /* The GPIO driver allocates a GPIOTE IN channel for an edge interrupt. */
+    for (ch = 0; ch < GPIOTE_CH_NUM; ch++) {
+        mode = ((NRF_GPIOTE->CONFIG[ch] & GPIOTE_CONFIG_MODE_Msk) >> GPIOTE_CONFIG_MODE_Pos);
+        if ((GPIOTE_CONFIG_MODE_Event == mode) &&
+            (abs_pin == nrf_gpiote_event_pin_get(NRF_GPIOTE, ch))) {
+            *p_event_addr = nrf_gpiote_event_address_get(NRF_GPIOTE, nrf_gpiote_in_event_get(ch));
+            return 0;
+        }
+    }
+    return -ENOTSUP;
+}
+#endif
+
 static int hc_sr04_init(const struct device *dev)
 {
     int err;
@@ -94,6 +340,15 @@ static int hc_sr04_init(const struct device *dev)
 
     p_data->sensor_value.val1 = 0;
     p_data->sensor_value.val2 = 0;
+    p_data->scale             = SPEED_TO_SCALE(METERS_PER_SEC * 1000);
+
+#if CONFIG_HC_SR04_STATS
+    stats_init(&p_data->stats.s_hdr,
+               STATS_SIZE_32,
+               ((sizeof(p_data->stats) - sizeof(struct stats_hdr)) / sizeof(uint32_t)),
+               STATS_NAME_INIT_PARMS(hc_sr04));
+    (void) stats_register(dev->name, &p_data->stats.s_hdr);
+#endif
 
     p_data->trig_dev = device_get_binding(p_cfg->trig_port);
     if (!p_data->trig_dev) {
@@ -107,108 +362,341 @@ static int hc_sr04_init(const struct device *dev)
     if (err != 0) {
         return err;
     }
+    /* The edge interrupt is only enabled while a measurement is pending. */
     err = gpio_pin_configure(p_data->echo_dev, p_cfg->echo_pin, (GPIO_INPUT | p_cfg->echo_flags));
     if (err != 0) {
         return err;
     }
-    err = gpio_pin_interrupt_configure(p_data->echo_dev,
-                                       p_cfg->echo_pin,
-                                       GPIO_INT_EDGE_BOTH);
-    if (err != 0) {
+    gpio_init_callback(&p_data->echo_cb_data, input_changed, BIT(p_cfg->echo_pin));
+
+    err = k_sem_init(&p_data->fetch_sem, 0, 1);
+    if (0 != err) {
         return err;
     }
-    gpio_init_callback(&p_data->echo_cb_data, input_changed, BIT(p_cfg->echo_pin));
+#if CONFIG_HC_SR04_CONCURRENT
+    err = k_sem_init(&p_data->lock_sem, 1, 1);
+    if (0 != err) {
+        return err;
+    }
+#endif
 
-    if (m_shared_resources.ready) {
-        /* Already initialized */
-        return 0;
+#if CONFIG_HC_SR04_TRIGGER
+    p_data->dev = dev;
+    k_delayed_work_init(&p_data->work, trigger_work_handler);
+#endif
+
+    if (!m_shared_resources.ready) {
+#if !CONFIG_HC_SR04_CONCURRENT
+        err = k_sem_init(&m_shared_resources.lock_sem, 1, 1);
+        if (0 != err) {
+            return err;
+        }
+#endif
+#if CONFIG_HC_SR04_HW_CAPTURE
+        err = capture_init();
+        if (0 != err) {
+            LOG_ERR("TIMER capture init failed: %d", err);
+            return err;
+        }
+#endif
+        m_shared_resources.ready = true;
+    }
+
+    p_data->state = HC_SR04_STATE_IDLE;
+    p_data->ready = true;
+    return 0;
+}
+
+/*
+ * Waits for the spurious pulse after an invalid echo to pass before the next
+ * TRIG. A wait longer than the settle time means the cycle counter has wrapped
+ * since and there is nothing left to wait for.
+ */
+static void settle_wait(struct hc_sr04_data *p_data)
+{
+    int32_t wait;
+
+    if (!p_data->settling) {
+        return;
+    }
+    p_data->settling = false;
+    wait = (int32_t)(p_data->settle_time - k_cycle_get_32());
+    if ((0 < wait) && ((int32_t)k_us_to_cyc_ceil32(T_SETTLE_US) >= wait)) {
+        k_busy_wait(k_cyc_to_us_ceil32(wait));
+    }
+}
+
+static int measurement_start(const struct device *dev, bool async)
+{
+    int err;
+#if CONFIG_HC_SR04_HW_CAPTURE
+    uint32_t echo_event_addr;
+#endif
+
+    struct hc_sr04_data      *p_data = dev->data;
+    const struct hc_sr04_cfg *p_cfg  = dev->config;
+
+    err = gpio_add_callback(p_data->echo_dev, &p_data->echo_cb_data);
+    if (0 != err) {
+        DATA_STATS_INC(p_data, gpio_errors);
+        return -EIO;
     }
 
-    err = k_sem_init(&m_shared_resources.fetch_sem, 0, 1);
+    settle_wait(p_data);
+    k_sem_reset(&p_data->fetch_sem);
+    p_data->async = async;
+    p_data->state = HC_SR04_STATE_RISING_EDGE;
+
+    err = gpio_pin_interrupt_configure(p_data->echo_dev, p_cfg->echo_pin, GPIO_INT_EDGE_BOTH);
     if (0 != err) {
-        return err;
+        DATA_STATS_INC(p_data, gpio_errors);
+        (void) gpio_remove_callback(p_data->echo_dev, &p_data->echo_cb_data);
+        return -EIO;
     }
-    err = k_mutex_init(&m_shared_resources.mutex);
+#if CONFIG_HC_SR04_HW_CAPTURE
+    /* The GPIO driver may pick another GPIOTE channel every time. */
+    err = capture_event_find(p_cfg->echo_abs_pin, &echo_event_addr);
     if (0 != err) {
+        DATA_STATS_INC(p_data, gpio_errors);
+        (void) gpio_pin_interrupt_configure(p_data->echo_dev, p_cfg->echo_pin, GPIO_INT_DISABLE);
+        (void) gpio_remove_callback(p_data->echo_dev, &p_data->echo_cb_data);
         return err;
     }
-
-    m_shared_resources.state = HC_SR04_STATE_IDLE;
-    m_shared_resources.ready = true;
+    nrf_ppi_event_endpoint_setup(NRF_PPI, m_shared_resources.rise_channel, echo_event_addr);
+    nrf_ppi_event_endpoint_setup(NRF_PPI, m_shared_resources.fall_channel, echo_event_addr);
+    (void) nrfx_ppi_group_enable(m_shared_resources.rise_group);
+    nrfx_timer_clear(&m_capture_timer);
+    nrfx_timer_enable(&m_capture_timer);
+#endif
+    p_data->trigger_time = k_cycle_get_32();
+#if CONFIG_HC_SR04_FAST_TRIG
+    p_cfg->trig_pulse();
+#else
+    gpio_pin_set(p_data->trig_dev, p_cfg->trig_pin, 1);
+    k_busy_wait(T_TRIG_PULSE_US);
+    gpio_pin_set(p_data->trig_dev, p_cfg->trig_pin, 0);
+#endif
     return 0;
 }
 
-static int hc_sr04_sample_fetch(const struct device *dev, enum sensor_channel chan)
+static int measurement_finish(const struct device *dev, bool completed)
 {
-    int      err;
     uint32_t count;
 
     struct hc_sr04_data      *p_data = dev->data;
     const struct hc_sr04_cfg *p_cfg  = dev->config;
 
-    if (unlikely((SENSOR_CHAN_ALL != chan) && (SENSOR_CHAN_DISTANCE != chan))) {
-        return -ENOTSUP;
+#if CONFIG_HC_SR04_HW_CAPTURE
+    nrfx_timer_disable(&m_capture_timer);
+#endif
+    (void) gpio_pin_interrupt_configure(p_data->echo_dev, p_cfg->echo_pin, GPIO_INT_DISABLE);
+
+    if (!completed) {
+        DATA_STATS_INC(p_data, timeouts);
+        p_data->state = HC_SR04_STATE_IDLE;
+        /* Already gone if the async path removed it first. */
+        (void) gpio_remove_callback(p_data->echo_dev, &p_data->echo_cb_data);
+        return -EIO;
     }
 
-    if (unlikely(!m_shared_resources.ready)) {
-        LOG_ERR("Driver is not initialized yet");
-        return -EBUSY;
+    __ASSERT_NO_MSG(HC_SR04_STATE_FINISHED == p_data->state);
+    p_data->state = HC_SR04_STATE_IDLE;
+
+    p_data->timestamps.trigger    = p_data->trigger_time;
+#if CONFIG_HC_SR04_HW_CAPTURE
+    /* The TIMER was started right before TRIG and counts microseconds. */
+    p_data->timestamps.echo_start = p_data->start_time;
+    p_data->timestamps.echo_end   = p_data->end_time;
+#else
+    p_data->timestamps.echo_start = k_cyc_to_us_near32(p_data->start_time -
+                                                       p_data->trigger_time);
+    p_data->timestamps.echo_end   = k_cyc_to_us_near32(p_data->end_time -
+                                                       p_data->trigger_time);
+#endif
+    count = (p_data->timestamps.echo_end - p_data->timestamps.echo_start);
+    DATA_STATS_SET(p_data, last_echo_us, count);
+    if (count_to_sensor_value(p_data->scale, count, &p_data->sensor_value)) {
+        DATA_STATS_INC(p_data, valid);
+    } else {
+        DATA_STATS_INC(p_data, invalid);
+        /* Waited out by the next measurement, not here on the work queue. */
+        p_data->settle_time = (k_cycle_get_32() + k_us_to_cyc_ceil32(T_SETTLE_US));
+        p_data->settling    = true;
     }
+    return 0;
+}
+
+static int lock_take(struct hc_sr04_data *p_data)
+{
+#if CONFIG_HC_SR04_STATS
+    int      err;
+    uint32_t start = k_cycle_get_32();
+    uint32_t wait_us;
+
+    err     = k_sem_take(lock_get(p_data), K_FOREVER);
+    wait_us = k_cyc_to_us_near32(k_cycle_get_32() - start);
+    STATS_INCN(p_data->stats, lock_wait_us, wait_us);
+    if (p_data->stats.lock_wait_max_us < wait_us) {
+        p_data->stats.lock_wait_max_us = wait_us;
+    }
+    return err;
+#else
+    return k_sem_take(lock_get(p_data), K_FOREVER);
+#endif
+}
 
-    err = k_mutex_lock(&m_shared_resources.mutex, K_FOREVER);
+#if CONFIG_HC_SR04_TRIGGER
+static void trigger_work_handler(struct k_work *work)
+{
+    struct hc_sr04_data      *p_data = CONTAINER_OF(work, struct hc_sr04_data, work.work);
+    sensor_trigger_handler_t  handler;
+    int                       err;
+    bool                      completed = false;
+    bool                      pending;
+    unsigned int              key;
+#if CONFIG_HC_SR04_FETCH_ASYNC
+    struct k_poll_signal     *p_signal;
+#endif
+
+    /*
+     * Submitted by input_changed() on completion or by the timeout. The
+     * callback is removed together with the decision, so a falling edge
+     * right after the timeout can't submit the work and finish again.
+     */
+    key = irq_lock();
+    pending       = p_data->async;
+    p_data->async = false;
+    if (pending) {
+        (void) gpio_remove_callback(p_data->echo_dev, &p_data->echo_cb_data);
+        completed = (0 == k_sem_take(&p_data->fetch_sem, K_NO_WAIT));
+    }
+    irq_unlock(key);
+    if (!pending) {
+        return;
+    }
+
+    err = measurement_finish(p_data->dev, completed);
+#if CONFIG_HC_SR04_FETCH_ASYNC
+    p_signal         = p_data->p_signal;
+    p_data->p_signal = NULL;
+#endif
+    k_sem_give(lock_get(p_data));
+#if CONFIG_HC_SR04_FETCH_ASYNC
+    if (NULL != p_signal) {
+        (void) k_poll_signal_raise(p_signal, err);
+    }
+#endif
+    if (0 != err) {
+        return;
+    }
+
+    handler = p_data->data_ready_handler;
+    if (NULL != handler) {
+        p_data->data_ready_thread = k_current_get();
+        handler(p_data->dev, &p_data->data_ready_trigger);
+        p_data->data_ready_thread = NULL;
+    }
+}
+
+/* Must be called with the device's lock held. */
+static int async_start(const struct device *dev)
+{
+    int err;
+
+    struct hc_sr04_data *p_data = dev->data;
+
+    err = measurement_start(dev, true);
     if (0 != err) {
         return err;
     }
+    /* The falling edge reschedules this immediately on completion. */
+    (void) k_delayed_work_submit(&p_data->work, K_MSEC(T_MAX_WAIT_MS));
+    return 0;
+}
 
-    err = gpio_add_callback(p_data->echo_dev, &p_data->echo_cb_data);
+static int async_fetch(const struct device *dev)
+{
+    int err;
+
+    struct hc_sr04_data *p_data = dev->data;
+
+    if (0 != k_sem_take(lock_get(p_data), K_NO_WAIT)) {
+        return -EBUSY;
+    }
+    err = async_start(dev);
     if (0 != err) {
-        LOG_DBG("Failed to add HC-SR04 echo callback");
-        (void) k_mutex_unlock(&m_shared_resources.mutex);
-        return -EIO;
+        k_sem_give(lock_get(p_data));
     }
+    return err;
+}
 
-    m_shared_resources.state = HC_SR04_STATE_RISING_EDGE;
-    gpio_pin_set(p_data->trig_dev, p_cfg->trig_pin, 1);
-    k_busy_wait(T_TRIG_PULSE_US);
-    gpio_pin_set(p_data->trig_dev, p_cfg->trig_pin, 0);
+static int hc_sr04_trigger_set(const struct device *dev,
+                    const struct sensor_trigger *trig,
+                    sensor_trigger_handler_t handler)
+{
+    struct hc_sr04_data *p_data = dev->data;
+    unsigned int         key;
 
-    if (0 != k_sem_take(&m_shared_resources.fetch_sem, K_MSEC(T_MAX_WAIT_MS))) {
-        LOG_DBG("No response from HC-SR04");
-        (void) k_mutex_unlock(&m_shared_resources.mutex);
-        err = gpio_remove_callback(p_data->echo_dev, &p_data->echo_cb_data);
-        if (0 != err) {
-            return err;
-        }
-        return -EIO;
+    if (SENSOR_TRIG_DATA_READY != trig->type) {
+        return -ENOTSUP;
+    }
+    if ((SENSOR_CHAN_ALL != trig->chan) && (SENSOR_CHAN_DISTANCE != trig->chan)) {
+        return -ENOTSUP;
     }
 
-    __ASSERT_NO_MSG(HC_SR04_STATE_FINISHED == m_shared_resources.state);
+    key = irq_lock();
+    p_data->data_ready_trigger = *trig;
+    p_data->data_ready_handler = handler;
+    irq_unlock(key);
+    return 0;
+}
+#endif
 
-    if (m_shared_resources.start_time <= m_shared_resources.end_time) {
-        count = (m_shared_resources.end_time - m_shared_resources.start_time);
-    } else {
-        count =  (0xFFFFFFFF - m_shared_resources.start_time);
-        count += m_shared_resources.end_time;
-    }
-    /* Convert from ticks to nanoseconds and then to microseconds */
-    count = k_cyc_to_us_near32(count);
-    if ((T_INVALID_PULSE_US > count) && (T_TRIG_PULSE_US < count)) {
-        /* Convert to meters and divide round-trip distance by two */
-        count = (count * METERS_PER_SEC / 2);
-        p_data->sensor_value.val2 = (count % 1000000);
-        p_data->sensor_value.val1 = (count / 1000000);
-    } else {
-        LOG_INF("Invalid measurement");
-        p_data->sensor_value.val1 = 0;
-        p_data->sensor_value.val2 = 0;
-        k_usleep(T_SPURIOS_WAIT_US);
+static int hc_sr04_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+    int  err;
+    bool completed;
+
+    struct hc_sr04_data *p_data = dev->data;
+
+    if (unlikely((SENSOR_CHAN_ALL != chan) && (SENSOR_CHAN_DISTANCE != chan))) {
+        return -ENOTSUP;
+    }
+
+    if (unlikely(!p_data->ready)) {
+        LOG_ERR("Driver is not initialized yet");
+        return -EBUSY;
+    }
+
+#if CONFIG_HC_SR04_TRIGGER
+    if (k_current_get() == p_data->data_ready_thread) {
+        /* The handler's measurement is already in sensor_value; don't start another. */
+        return 0;
+    }
+#endif
+
+    DATA_STATS_INC(p_data, fetches);
+
+#if CONFIG_HC_SR04_TRIGGER
+    if (NULL != p_data->data_ready_handler) {
+        /* Completion is reported through the DATA_READY handler. */
+        return async_fetch(dev);
     }
+#endif
 
-    err = k_mutex_unlock(&m_shared_resources.mutex);
+    err = lock_take(p_data);
     if (0 != err) {
         return err;
     }
-    return 0;
+
+    err = measurement_start(dev, false);
+    if (0 == err) {
+        completed = (0 == k_sem_take(&p_data->fetch_sem, K_MSEC(T_MAX_WAIT_MS)));
+        err = measurement_finish(dev, completed);
+    }
+
+    k_sem_give(lock_get(p_data));
+    return err;
 }
 
 static int hc_sr04_channel_get(const struct device *dev,
@@ -217,7 +705,7 @@ static int hc_sr04_channel_get(const struct device *dev,
 {
     const struct hc_sr04_data *p_data = dev->data;
 
-    if (unlikely(!m_shared_resources.ready)) {
+    if (unlikely(!p_data->ready)) {
         LOG_WRN("Device is not initialized yet");
         return -EBUSY;
     }
@@ -233,14 +721,170 @@ static int hc_sr04_channel_get(const struct device *dev,
     return 0;
 }
 
+#if CONFIG_HC_SR04_FETCH_ASYNC
+int hc_sr04_fetch_async(const struct device *dev, struct k_poll_signal *signal)
+{
+    int err;
+
+    struct hc_sr04_data *p_data = dev->data;
+
+    if (unlikely(!p_data->ready)) {
+        LOG_ERR("Driver is not initialized yet");
+        return -EBUSY;
+    }
+    if (NULL == signal) {
+        return -EINVAL;
+    }
+
+    DATA_STATS_INC(p_data, fetches);
+
+    if (0 != k_sem_take(lock_get(p_data), K_NO_WAIT)) {
+        return -EBUSY;
+    }
+    p_data->p_signal = signal;
+    err = async_start(dev);
+    if (0 != err) {
+        p_data->p_signal = NULL;
+        k_sem_give(lock_get(p_data));
+    }
+    return err;
+}
+#endif
+
+int hc_sr04_timestamps_get(const struct device *dev, struct hc_sr04_timestamps *p_ts)
+{
+    const struct hc_sr04_data *p_data = dev->data;
+
+    if (unlikely(!p_data->ready)) {
+        LOG_WRN("Device is not initialized yet");
+        return -EBUSY;
+    }
+
+    *p_ts = p_data->timestamps;
+    return 0;
+}
+
+static int hc_sr04_attr_set(const struct device *dev,
+                    enum sensor_channel chan,
+                    enum sensor_attribute attr,
+                    const struct sensor_value *val)
+{
+    struct hc_sr04_data *p_data = dev->data;
+    int64_t              milli;
+
+    if ((SENSOR_CHAN_ALL != chan) && (SENSOR_CHAN_DISTANCE != chan)) {
+        return -ENOTSUP;
+    }
+
+    milli = (((int64_t)val->val1 * 1000) + (val->val2 / 1000));
+
+    switch ((int)attr) {
+    case HC_SR04_ATTR_AMBIENT_TEMP:
+        if ((AMBIENT_MC_MIN > milli) || (AMBIENT_MC_MAX < milli)) {
+            return -EINVAL;
+        }
+        p_data->scale = SPEED_TO_SCALE(SOUND_MM_PER_SEC_0C +
+                                       (milli * SOUND_MM_PER_SEC_PER_C / 1000));
+        break;
+    case HC_SR04_ATTR_SPEED_OF_SOUND:
+        if ((SOUND_MM_PER_SEC_MIN > milli) || (SOUND_MM_PER_SEC_MAX < milli)) {
+            return -EINVAL;
+        }
+        p_data->scale = SPEED_TO_SCALE(milli);
+        break;
+    default:
+        return -ENOTSUP;
+    }
+    return 0;
+}
+
 static const struct sensor_driver_api hc_sr04_driver_api = {
+#if CONFIG_HC_SR04_TRIGGER
+    .trigger_set  = hc_sr04_trigger_set,
+#endif
+    .attr_set     = hc_sr04_attr_set,
     .sample_fetch = hc_sr04_sample_fetch,
     .channel_get  = hc_sr04_channel_get,
 };
 
+#if CONFIG_HC_SR04_STATS && CONFIG_SHELL
+static int stats_print(struct stats_hdr *p_hdr, void *p_arg, const char *p_name, uint16_t off)
+{
+    shell_print((const struct shell *)p_arg, "%s: %u",
+                p_name, *(uint32_t *)((uint8_t *)p_hdr + off));
+    return 0;
+}
+
+static struct hc_sr04_data *shell_data_get(const struct shell *shell, const char *name)
+{
+    const struct device *dev = device_get_binding(name);
+
+    if ((NULL == dev) || (&hc_sr04_driver_api != dev->api)) {
+        shell_error(shell, "%s is not an HC-SR04 device", name);
+        return NULL;
+    }
+    return dev->data;
+}
+
+static int cmd_stats(const struct shell *shell, size_t argc, char **argv)
+{
+    struct hc_sr04_data *p_data = shell_data_get(shell, argv[1]);
+
+    if (NULL == p_data) {
+        return -ENODEV;
+    }
+    return stats_walk(&p_data->stats.s_hdr, stats_print, (void *)shell);
+}
+
+static int cmd_reset(const struct shell *shell, size_t argc, char **argv)
+{
+    struct hc_sr04_data *p_data = shell_data_get(shell, argv[1]);
+
+    if (NULL == p_data) {
+        return -ENODEV;
+    }
+    stats_reset(&p_data->stats.s_hdr);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(hc_sr04_cmds,
+    SHELL_CMD_ARG(stats, NULL, "Show the counters of <device>", cmd_stats, 2, 0),
+    SHELL_CMD_ARG(reset, NULL, "Clear the counters of <device>", cmd_reset, 2, 0),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(hc_sr04, &hc_sr04_cmds, "HC-SR04 statistics", NULL);
+#endif
+
 #define INST(num) DT_INST(num, elecfreaks_hc_sr04)
 
+#if CONFIG_HC_SR04_HW_CAPTURE
+/* nRF SoCs have at most two ports, P1 pins are numbered from 32. */
+#define ECHO_ABS_PIN_CFG(n) \
+    .echo_abs_pin = (DT_GPIO_PIN(INST(n), echo_gpios) + \
+                     ((DT_REG_ADDR(DT_GPIO_CTLR(INST(n), echo_gpios)) == \
+                       DT_REG_ADDR(DT_NODELABEL(gpio0))) ? 0 : 32)),
+#else
+#define ECHO_ABS_PIN_CFG(n)
+#endif
+
+#if CONFIG_HC_SR04_FAST_TRIG
+#define TRIG_PULSE_DEFINE(n) \
+    static void trig_pulse_##n(void) \
+    { \
+        trig_pulse((NRF_GPIO_Type *)DT_REG_ADDR(DT_GPIO_CTLR(INST(n), trig_gpios)), \
+                   BIT(DT_GPIO_PIN(INST(n), trig_gpios)), \
+                   (0 != (DT_GPIO_FLAGS(INST(n), trig_gpios) & GPIO_ACTIVE_LOW))); \
+    }
+#define TRIG_PULSE_CFG(n) \
+    .trig_pulse = trig_pulse_##n,
+#else
+#define TRIG_PULSE_DEFINE(n)
+#define TRIG_PULSE_CFG(n)
+#endif
+
 #define HC_SR04_DEVICE(n) \
+    TRIG_PULSE_DEFINE(n) \
     static const struct hc_sr04_cfg hc_sr04_cfg_##n = { \
         .trig_port  = DT_GPIO_LABEL(INST(n), trig_gpios), \
         .trig_pin   = DT_GPIO_PIN(INST(n),   trig_gpios), \
@@ -248,6 +892,8 @@ static const struct sensor_driver_api hc_sr04_driver_api = {
         .echo_port  = DT_GPIO_LABEL(INST(n), echo_gpios), \
         .echo_pin   = DT_GPIO_PIN(INST(n),   echo_gpios), \
         .echo_flags = DT_GPIO_FLAGS(INST(n), echo_gpios), \
+        ECHO_ABS_PIN_CFG(n) \
+        TRIG_PULSE_CFG(n) \
     }; \
     static struct hc_sr04_data hc_sr04_data_##n; \
     DEVICE_AND_API_INIT(hc_sr04_##n, \
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2020 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+ * Echo conversions and filters shared by the HC-SR04 drivers. Nothing in here
+ * touches the hardware, so the unit tests in tests/drivers/sensor/hc_sr04 use
+ * it as is.
+ *
+ * Define HC_SR04_FILTER_SIZE (median window) and HC_SR04_HISTORY_SIZE
+ * (velocity samples) before including this file to get the filter and the
+ * velocity history.
+ */
+
+#ifndef HC_SR04_CALC_H__
+#define HC_SR04_CALC_H__
+
+#include <kernel.h>
+#include <drivers/sensor.h>
+
+/* Timings defined by spec */
+#define T_TRIG_PULSE_US       11
+#define T_INVALID_PULSE_US    25000
+
+/* Q16 micrometers per microsecond of echo, halved for the round trip */
+#define SCALE_SHIFT           16
+#define SPEED_TO_SCALE(mm_per_sec) ((uint32_t)(((uint64_t)(mm_per_sec) << SCALE_SHIFT) / 2000))
+
+static inline bool count_is_valid(uint32_t count)
+{
+    return ((T_INVALID_PULSE_US > count) && (T_TRIG_PULSE_US < count));
+}
+
+/* Returns false and a zero distance for invalid echo widths. */
+static inline bool count_to_sensor_value(uint32_t scale,
+                                         uint32_t count,
+                                         struct sensor_value *p_value)
+{
+    uint32_t um;
+
+    if (count_is_valid(count)) {
+        /* The divisions by a constant are compiled into multiplications. */
+        um = (uint32_t)(((uint64_t)count * scale) >> SCALE_SHIFT);
+        p_value->val2 = (um % 1000000);
+        p_value->val1 = (um / 1000000);
+        return true;
+    }
+    p_value->val1 = 0;
+    p_value->val2 = 0;
+    return false;
+}
+
+static inline bool timer_count_before(uint32_t a, uint32_t b)
+{
+    /* Compare two 24-bit TIMER counts across a wrap-around */
+    return ((int32_t)((a - b) << 8) < 0);
+}
+
+#ifdef HC_SR04_FILTER_SIZE
+#define EMA_SHIFT             16
+#define EMA_ONE               (1 << EMA_SHIFT)
+
+struct hc_sr04_filter {
+    uint32_t window[HC_SR04_FILTER_SIZE]; /* Latest valid echo widths */
+    size_t   len;   /* Median window size */
+    size_t   count; /* Number of widths in window */
+    size_t   next;
+    uint32_t alpha; /* EMA weight of a new median, EMA_ONE disables the EMA */
+    uint32_t ema;   /* Microseconds << EMA_SHIFT */
+};
+
+static inline void filter_reset(struct hc_sr04_filter *p_filter)
+{
+    p_filter->count = 0;
+    p_filter->next  = 0;
+}
+
+static inline uint32_t filter_median_get(const struct hc_sr04_filter *p_filter)
+{
+    uint32_t sorted[HC_SR04_FILTER_SIZE];
+    size_t   i;
+    size_t   j;
+
+    /* Insertion sort, the window is small. */
+    for (i = 0; i < p_filter->count; i++) {
+        for (j = i; (0 < j) && (sorted[j - 1] > p_filter->window[i]); j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = p_filter->window[i];
+    }
+    return sorted[p_filter->count / 2];
+}
+
+static inline void filter_add(struct hc_sr04_filter *p_filter, uint32_t count)
+{
+    int64_t median;
+    bool    first = (0 == p_filter->count);
+
+    p_filter->window[p_filter->next++] = count;
+    if (p_filter->len <= p_filter->next) {
+        p_filter->next = 0;
+    }
+    if (p_filter->len > p_filter->count) {
+        p_filter->count++;
+    }
+
+    median = ((int64_t)filter_median_get(p_filter) << EMA_SHIFT);
+    if (first) {
+        p_filter->ema = (uint32_t)median;
+    } else {
+        p_filter->ema += (int32_t)(((median - p_filter->ema) * p_filter->alpha) >> EMA_SHIFT);
+    }
+}
+
+static inline uint32_t filter_output_get(const struct hc_sr04_filter *p_filter)
+{
+    return ((p_filter->ema + (EMA_ONE / 2)) >> EMA_SHIFT);
+}
+#endif
+
+#ifdef HC_SR04_HISTORY_SIZE
+/* Latest valid samples, oldest at head once the ring is full. */
+struct hc_sr04_history {
+    uint32_t trigger[HC_SR04_HISTORY_SIZE]; /* k_cycle_get_32() */
+    int32_t  um[HC_SR04_HISTORY_SIZE];
+    uint8_t  head;
+    uint8_t  count;
+};
+
+static inline void history_reset(struct hc_sr04_history *p_history)
+{
+    p_history->head  = 0;
+    p_history->count = 0;
+}
+
+/* Adds a sample unless it is already the newest one. */
+static inline void history_add(struct hc_sr04_history *p_history, uint32_t trigger, int32_t um)
+{
+    uint8_t newest;
+
+    if (0 < p_history->count) {
+        newest = ((p_history->head + HC_SR04_HISTORY_SIZE - 1) % HC_SR04_HISTORY_SIZE);
+        if (p_history->trigger[newest] == trigger) {
+            /* Continuous or scheduler mode returned the same sample again. */
+            return;
+        }
+    }
+
+    p_history->trigger[p_history->head] = trigger;
+    p_history->um[p_history->head]      = um;
+    p_history->head = ((p_history->head + 1) % HC_SR04_HISTORY_SIZE);
+    if (HC_SR04_HISTORY_SIZE > p_history->count) {
+        p_history->count++;
+    }
+}
+
+/* Approach speed from the oldest to the newest sample, positive when closing in. */
+static inline int history_velocity_get(const struct hc_sr04_history *p_history,
+                                       struct sensor_value *p_value)
+{
+    uint8_t  oldest;
+    uint8_t  newest;
+    uint32_t dt_us;
+    int64_t  um_per_sec;
+
+    if (2 > p_history->count) {
+        return -ENODATA;
+    }
+    oldest = ((HC_SR04_HISTORY_SIZE > p_history->count) ? 0 : p_history->head);
+    newest = ((p_history->head + HC_SR04_HISTORY_SIZE - 1) % HC_SR04_HISTORY_SIZE);
+    dt_us  = k_cyc_to_us_near32(p_history->trigger[newest] - p_history->trigger[oldest]);
+    if (0 == dt_us) {
+        return -ENODATA;
+    }
+
+    /* Micrometers per microsecond are meters per second. */
+    um_per_sec = ((((int64_t)p_history->um[oldest] - p_history->um[newest]) * 1000000) /
+                  dt_us);
+    p_value->val1 = (int32_t)(um_per_sec / 1000000);
+    p_value->val2 = (int32_t)(um_per_sec % 1000000);
+    return 0;
+}
+#endif
+
+#endif /* HC_SR04_CALC_H__ */
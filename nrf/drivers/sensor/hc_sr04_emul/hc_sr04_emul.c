@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2020 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#define DT_DRV_COMPAT elecfreaks_hc_sr04_emul
+
+#include <kernel.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include <sys/slist.h>
+#include <sensor/hc_sr04_emul.h>
+
+#define TRIG_PIN              DT_INST_PROP(0, trig_pin)
+#define ECHO_PIN              DT_INST_PROP(0, echo_pin)
+#define EDGE_COUNT_MAX        4
+
+BUILD_ASSERT(1 == DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT),
+             "hc-sr04-emul: exactly one emulated sensor is supported");
+
+struct emul_gpio_cfg {
+    struct gpio_driver_config common; /* Must be first */
+};
+
+struct emul_gpio_data {
+    struct gpio_driver_data common; /* Must be first */
+    sys_slist_t             callbacks;
+    gpio_port_value_t       out;
+    gpio_port_value_t       in;
+    gpio_port_pins_t        int_rising;  /* Pins interrupting on a rising edge */
+    gpio_port_pins_t        int_falling; /* Pins interrupting on a falling edge */
+};
+
+static struct {
+    const struct device      *dev;
+    struct k_timer            timer;
+    struct hc_sr04_emul_echo  echo;
+    uint32_t                  edges[EDGE_COUNT_MAX]; /* Microseconds since the previous edge */
+    size_t                    edge_count;
+    size_t                    edge_idx;
+    uint32_t                  trig_count;
+} m_sensor;
+
+static void callbacks_fire(const struct device *dev, gpio_port_pins_t pins)
+{
+    struct emul_gpio_data *p_data = dev->data;
+    struct gpio_callback  *p_cb;
+    struct gpio_callback  *p_tmp;
+
+    /* Handlers may remove themselves. */
+    SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&p_data->callbacks, p_cb, p_tmp, node) {
+        if (0 != (p_cb->pin_mask & pins)) {
+            p_cb->handler(dev, p_cb, (p_cb->pin_mask & pins));
+        }
+    }
+}
+
+static void echo_edge(struct k_timer *p_timer)
+{
+    struct emul_gpio_data *p_data = m_sensor.dev->data;
+    gpio_port_pins_t       int_pins;
+
+    p_data->in ^= BIT(ECHO_PIN);
+    int_pins = ((0 != (p_data->in & BIT(ECHO_PIN))) ? p_data->int_rising : p_data->int_falling);
+    if (0 != (int_pins & BIT(ECHO_PIN))) {
+        callbacks_fire(m_sensor.dev, BIT(ECHO_PIN));
+    }
+
+    m_sensor.edge_idx++;
+    if (m_sensor.edge_count > m_sensor.edge_idx) {
+        k_timer_start(p_timer, K_USEC(m_sensor.edges[m_sensor.edge_idx]), K_NO_WAIT);
+    }
+}
+
+static void sensor_trig(void)
+{
+    m_sensor.trig_count++;
+    if (hc_sr04_emul_busy() || (0 == m_sensor.echo.width_us)) {
+        return;
+    }
+
+    m_sensor.edges[0]   = m_sensor.echo.delay_us;
+    m_sensor.edges[1]   = m_sensor.echo.width_us;
+    m_sensor.edge_count = 2;
+    if (m_sensor.echo.spurious) {
+        m_sensor.edges[2]   = HC_SR04_EMUL_SPURIOUS_DELAY_US;
+        m_sensor.edges[3]   = HC_SR04_EMUL_SPURIOUS_WIDTH_US;
+        m_sensor.edge_count = 4;
+    }
+    m_sensor.edge_idx = 0;
+    k_timer_start(&m_sensor.timer, K_USEC(m_sensor.edges[0]), K_NO_WAIT);
+}
+
+static void out_set(const struct device *dev, gpio_port_value_t out)
+{
+    struct emul_gpio_data *p_data = dev->data;
+    bool                   trig_fell;
+
+    trig_fell = ((0 != (p_data->out & BIT(TRIG_PIN))) && (0 == (out & BIT(TRIG_PIN))));
+    p_data->out = out;
+    if (trig_fell) {
+        sensor_trig();
+    }
+}
+
+void hc_sr04_emul_echo_set(const struct hc_sr04_emul_echo *p_echo)
+{
+    m_sensor.echo = *p_echo;
+}
+
+uint32_t hc_sr04_emul_trig_count(void)
+{
+    return m_sensor.trig_count;
+}
+
+bool hc_sr04_emul_busy(void)
+{
+    return (m_sensor.edge_count > m_sensor.edge_idx);
+}
+
+static int emul_gpio_pin_configure(const struct device *dev, gpio_pin_t pin, gpio_flags_t flags)
+{
+    return 0;
+}
+
+static int emul_gpio_port_get_raw(const struct device *dev, gpio_port_value_t *value)
+{
+    const struct emul_gpio_data *p_data = dev->data;
+
+    *value = ((p_data->out & ~BIT(ECHO_PIN)) | p_data->in);
+    return 0;
+}
+
+static int emul_gpio_port_set_masked_raw(const struct device *dev,
+                                         gpio_port_pins_t mask,
+                                         gpio_port_value_t value)
+{
+    const struct emul_gpio_data *p_data = dev->data;
+
+    out_set(dev, ((p_data->out & ~mask) | (value & mask)));
+    return 0;
+}
+
+static int emul_gpio_port_set_bits_raw(const struct device *dev, gpio_port_pins_t pins)
+{
+    const struct emul_gpio_data *p_data = dev->data;
+
+    out_set(dev, (p_data->out | pins));
+    return 0;
+}
+
+static int emul_gpio_port_clear_bits_raw(const struct device *dev, gpio_port_pins_t pins)
+{
+    const struct emul_gpio_data *p_data = dev->data;
+
+    out_set(dev, (p_data->out & ~pins));
+    return 0;
+}
+
+static int emul_gpio_port_toggle_bits(const struct device *dev, gpio_port_pins_t pins)
+{
+    const struct emul_gpio_data *p_data = dev->data;
+
+    out_set(dev, (p_data->out ^ pins));
+    return 0;
+}
+
+static int emul_gpio_pin_interrupt_configure(const struct device *dev,
+                                             gpio_pin_t pin,
+                                             enum gpio_int_mode mode,
+                                             enum gpio_int_trig trig)
+{
+    struct emul_gpio_data *p_data = dev->data;
+    bool                   edge   = (GPIO_INT_MODE_EDGE == mode);
+
+    if (GPIO_INT_MODE_LEVEL == mode) {
+        return -ENOTSUP;
+    }
+    WRITE_BIT(p_data->int_rising,  pin, (edge && (0 != (GPIO_INT_TRIG_HIGH & trig))));
+    WRITE_BIT(p_data->int_falling, pin, (edge && (0 != (GPIO_INT_TRIG_LOW & trig))));
+    return 0;
+}
+
+static int emul_gpio_manage_callback(const struct device *dev,
+                                     struct gpio_callback *callback,
+                                     bool set)
+{
+    struct emul_gpio_data *p_data = dev->data;
+
+    if (!sys_slist_find_and_remove(&p_data->callbacks, &callback->node) && !set) {
+        return -EINVAL;
+    }
+    if (set) {
+        sys_slist_prepend(&p_data->callbacks, &callback->node);
+    }
+    return 0;
+}
+
+static const struct gpio_driver_api m_emul_gpio_api = {
+    .pin_configure           = emul_gpio_pin_configure,
+    .port_get_raw            = emul_gpio_port_get_raw,
+    .port_set_masked_raw     = emul_gpio_port_set_masked_raw,
+    .port_set_bits_raw       = emul_gpio_port_set_bits_raw,
+    .port_clear_bits_raw     = emul_gpio_port_clear_bits_raw,
+    .port_toggle_bits        = emul_gpio_port_toggle_bits,
+    .pin_interrupt_configure = emul_gpio_pin_interrupt_configure,
+    .manage_callback         = emul_gpio_manage_callback,
+};
+
+static int emul_gpio_init(const struct device *dev)
+{
+    struct emul_gpio_data *p_data = dev->data;
+
+    sys_slist_init(&p_data->callbacks);
+    m_sensor.dev           = dev;
+    m_sensor.echo.delay_us = HC_SR04_EMUL_DELAY_US;
+    m_sensor.echo.width_us = HC_SR04_EMUL_WIDTH_US;
+    k_timer_init(&m_sensor.timer, echo_edge, NULL);
+    return 0;
+}
+
+static const struct emul_gpio_cfg m_emul_gpio_cfg = {
+    .common = {
+        .port_pin_mask = GPIO_PORT_PIN_MASK_FROM_NGPIOS(32),
+    },
+};
+
+static struct emul_gpio_data m_emul_gpio_data;
+
+DEVICE_AND_API_INIT(hc_sr04_emul,
+                    DT_INST_LABEL(0),
+                    emul_gpio_init,
+                    &m_emul_gpio_data,
+                    &m_emul_gpio_cfg,
+                    PRE_KERNEL_1,
+                    CONFIG_KERNEL_INIT_PRIORITY_DEVICE,
+                    &m_emul_gpio_api);
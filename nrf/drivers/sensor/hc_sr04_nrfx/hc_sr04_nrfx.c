@@ -22,18 +22,44 @@
 #include <nrfx_gpiote.h>
 #include <nrfx_ppi.h>
 #include <nrfx_egu.h>
+#if CONFIG_GPIO
+#include <drivers/gpio.h>
+#endif
 #include <logging/log.h>
+#if CONFIG_HC_SR04_NRFX_STATS
+#include <stats/stats.h>
+#include <shell/shell.h>
+#endif
+
+#if CONFIG_HC_SR04_NRFX_FILTER
+#define HC_SR04_FILTER_SIZE   CONFIG_HC_SR04_NRFX_FILTER_MEDIAN_SIZE
+#endif
+#if CONFIG_HC_SR04_NRFX_VELOCITY
+#define HC_SR04_HISTORY_SIZE  CONFIG_HC_SR04_NRFX_VELOCITY_SAMPLES
+#endif
+#include "hc_sr04_calc.h"
 
 LOG_MODULE_REGISTER(hc_sr04_nrfx, CONFIG_HC_SR04_NRFX_LOG_LEVEL);
 
 /* Timings defined by spec */
-#define T_TRIG_PULSE_US       11
-#define T_INVALID_PULSE_US    25000
 #define T_MAX_WAIT_MS         130
 #define T_SPURIOS_WAIT_US     145
+#define T_INVALID_ECHO_US     128600
+#define T_ECHO_DELAY_US       1000 /* Upper bound from TRIG to the rising echo edge */
 #define METERS_PER_SEC        340
 
+/* Speed of sound in air is 331.3m/s at 0C and rises by 0.606m/s per degree */
+#define SOUND_MM_PER_SEC_0C   331300
+#define SOUND_MM_PER_SEC_PER_C 606
+#define SOUND_MM_PER_SEC_MIN  300000
+#define SOUND_MM_PER_SEC_MAX  400000
+#define AMBIENT_MC_MIN        (-40000)
+#define AMBIENT_MC_MAX        85000
+#define MAX_RANGE_UM_MIN      20000
+#define MAX_RANGE_UM_MAX      4000000
+
 #define EGU_EVENT_POS         0
+#define EGU_TIMEOUT_EVENT_POS 1
 
 #define TIMER_TRIG_UP_CHAN    0
 #define TIMER_TRIG_DOWN_CHAN  1
@@ -41,13 +67,105 @@ LOG_MODULE_REGISTER(hc_sr04_nrfx, CONFIG_HC_SR04_NRFX_LOG_LEVEL);
 #define TIMER_ECHO_END_CHAN   3
 #define TIMER_TRIG_UP_COUNT   1
 #define TIMER_TRIG_DOWN_COUNT (TIMER_TRIG_UP_COUNT + T_TRIG_PULSE_US)
+#define TIMER_COUNT_MASK      0x00FFFFFF
+
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+#define TIMER_TIMEOUT_CHAN    4
+#define TIMER_TIMEOUT_COUNT   (TIMER_TRIG_DOWN_COUNT + T_ECHO_DELAY_US + \
+                               (CONFIG_HC_SR04_NRFX_MAX_RANGE_MM * 2000 / METERS_PER_SEC))
+#endif
+
+#define T_RETRIGGER_HOLDOFF_US (2 * T_SPURIOS_WAIT_US)
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+#define T_PERIOD_US           (CONFIG_HC_SR04_NRFX_CONTINUOUS_PERIOD_MS * 1000)
+#define T_RETRIGGER_LEAD_US   50
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS_ADAPTIVE
+#define T_MIN_PERIOD_US       (CONFIG_HC_SR04_NRFX_CONTINUOUS_MIN_PERIOD_MS * 1000)
+#define ECHO_DECAY_FACTOR     4 /* Reverberations fade within a few round trips */
+#endif
+#else
+#define TIMER_BURST_UP_COUNT  MAX(CONFIG_HC_SR04_NRFX_BURST_GAP_US, T_RETRIGGER_HOLDOFF_US)
+#endif
+
+#define INSTANCE_COUNT        DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)
+#define POWER_PIN_NONE        UINT32_MAX
+
+#if CONFIG_HC_SR04_NRFX_STATS
+STATS_SECT_START(hc_sr04_nrfx)
+STATS_SECT_ENTRY32(fetches)
+STATS_SECT_ENTRY32(valid)
+STATS_SECT_ENTRY32(invalid)
+STATS_SECT_ENTRY32(timeouts)
+STATS_SECT_ENTRY32(out_of_range)
+STATS_SECT_ENTRY32(rejected) /* Outside the echo-window-mm */
+STATS_SECT_ENTRY32(gpiote_errors)
+STATS_SECT_ENTRY32(lock_wait_us) /* Total time spent waiting for the unit */
+STATS_SECT_ENTRY32(lock_wait_max_us)
+STATS_SECT_ENTRY32(last_echo_us)
+STATS_SECT_END;
+
+STATS_NAME_START(hc_sr04_nrfx)
+STATS_NAME(hc_sr04_nrfx, fetches)
+STATS_NAME(hc_sr04_nrfx, valid)
+STATS_NAME(hc_sr04_nrfx, invalid)
+STATS_NAME(hc_sr04_nrfx, timeouts)
+STATS_NAME(hc_sr04_nrfx, out_of_range)
+STATS_NAME(hc_sr04_nrfx, rejected)
+STATS_NAME(hc_sr04_nrfx, gpiote_errors)
+STATS_NAME(hc_sr04_nrfx, lock_wait_us)
+STATS_NAME(hc_sr04_nrfx, lock_wait_max_us)
+STATS_NAME(hc_sr04_nrfx, last_echo_us)
+STATS_NAME_END(hc_sr04_nrfx);
+
+/* p_data may be a void pointer to the instance data */
+#define DATA_STATS(p_data)                 (((struct hc_sr04_nrfx_data *)(p_data))->stats)
+#define DATA_STATS_INC(p_data, var)        STATS_INC(DATA_STATS(p_data), var)
+#define DATA_STATS_SET(p_data, var, value) (DATA_STATS(p_data).var = (value))
+#else
+#define DATA_STATS_INC(p_data, var)
+#define DATA_STATS_SET(p_data, var, value)
+#endif
+
+#define INST(num) DT_INST(num, elecfreaks_hc_sr04_nrfx)
+
+/* Instances without a timer property share the TIMER and EGU selected in Kconfig. */
+#define DEFAULT_UNIT_USER(n)  + !DT_NODE_HAS_PROP(INST(n), timer)
+#define DEFAULT_UNIT_USERS    (0 DT_INST_FOREACH_STATUS_OKAY(DEFAULT_UNIT_USER))
 
 static struct hc_sr04_nrfx_shared_resources {
-    nrfx_timer_t             timer;
-    struct k_sem             fetch_sem;
-    struct k_mutex           mutex;
+#if CONFIG_GPIO
+    const struct device     *gpio_ports[2];              /* gpio_nrfx devices for P0 and P1 */
+    uint32_t                 gpiote_pins[GPIOTE_CH_NUM]; /* Pin using each allocated channel */
+    uint32_t                 gpiote_used;                /* Channels allocated by this driver */
+#else
     nrfx_gpiote_in_config_t  echo_in;
     nrfx_gpiote_out_config_t trig_out;
+#endif
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+    const struct device     *sched_devs[INSTANCE_COUNT]; /* Sorted by scan-order */
+    size_t                   sched_count;
+#endif
+    bool                     ready; /* GPIOTE has been initialized */
+} m_shared_resources;
+
+/*
+ * A TIMER, EGU and set of PPI channels together with the state of the measurement
+ * that is using them. Instances that share a unit are measured one at a time while
+ * separate units range concurrently.
+ */
+struct hc_sr04_nrfx_unit {
+    nrfx_timer_t             timer;
+    nrfx_egu_t               egu;
+    uint8_t                  timer_irq_priority;
+    void                   (*irq_connect)(void);
+    struct k_sem             fetch_sem;
+    struct k_sem             lock_sem; /* Held for the duration of a measurement */
+    const struct device     *active_dev;
+#if CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
+    const struct device     *wired_dev; /* Instance the PPI endpoints point at */
+#endif
+    nrf_ppi_channel_group_t  rising_echo_group;
     nrf_ppi_channel_group_t  falling_echo_group;
     nrf_ppi_channel_t        trig_up_channel;
     nrf_ppi_channel_t        trig_down_channel;
@@ -55,23 +173,398 @@ static struct hc_sr04_nrfx_shared_resources {
     nrf_ppi_channel_t        rising_group_channel;
     nrf_ppi_channel_t        falling_group_channel;
     nrf_ppi_channel_t        clear_int_channel;
-    nrf_ppi_channel_t        capture_stop_channel;    
-    bool                     ready; /* The module has been initialized */
-} m_shared_resources;
+    nrf_ppi_channel_t        capture_stop_channel;
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    nrf_ppi_channel_t        timeout_int_channel;
+    nrf_ppi_channel_t        timeout_group_channel;
+    bool                     out_of_range; /* Set by the timeout compare */
+    uint32_t                 busy_until;   /* k_uptime_get_32() when the sensor can fire again */
+    uint32_t                 timeout_span;  /* From TRIG to the timeout compare */
+    uint32_t                 timeout_count; /* Timeout compare of the measurement in progress */
+#endif
+    uint32_t                *p_burst;
+    size_t                   burst_len; /* Non-zero while a burst is in progress */
+    size_t                   burst_idx;
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    uint32_t                 latest_count;
+    uint32_t                 latest_time; /* k_uptime_get_32() of the latest capture */
+    uint32_t                 latest_cycles; /* k_cycle_get_32() of the latest capture */
+    uint32_t                 latest_age_us; /* Time from TRIG to latest_cycles */
+    struct hc_sr04_nrfx_timestamps latest_ts;
+#if CONFIG_HC_SR04_NRFX_FILTER
+    struct hc_sr04_filter    filter;
+#endif
+#if CONFIG_HC_SR04_NRFX_STREAM
+    struct ring_buf         *p_stream; /* Consumer's buffer, NULL when not streaming */
+    uint32_t                 stream_dropped;
+#endif
+    bool                     has_sample;
+#else
+    uint32_t                 trigger_cycles; /* k_cycle_get_32() when the TIMER was started */
+    bool                     async; /* Completion is handled by the work queue */
+#endif
+    bool                     ready; /* The TIMER, EGU and PPI have been initialized */
+};
 
 struct hc_sr04_nrfx_data {
-    struct sensor_value sensor_value;
+    struct sensor_value      sensor_value;
+    uint32_t                 scale; /* Echo microseconds to micrometers, see SCALE_SHIFT */
+    uint32_t                 max_range_um; /* HC_SR04_NRFX_ATTR_MAX_RANGE, 0 for the full range */
+    uint32_t                 max_width;    /* Echo microseconds of max_range_um, see max_width_update */
+    int64_t                  ready_at;     /* k_uptime_get() from which TRIG is answered */
+    bool                     settling;     /* An invalid echo's spurious pulse may still follow */
+    uint32_t                 settle_time;  /* k_cycle_get_32() when that pulse has passed */
+    struct hc_sr04_nrfx_timestamps timestamps; /* Of sensor_value */
+#if CONFIG_HC_SR04_NRFX_VELOCITY
+    struct hc_sr04_history   history;
+#endif
+#if CONFIG_HC_SR04_NRFX_STATS
+    STATS_SECT_DECL(hc_sr04_nrfx) stats;
+#endif
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+    struct sensor_value      scheduled_value; /* Latest reading published by the scheduler */
+    struct hc_sr04_nrfx_timestamps scheduled_timestamps;
+    int                      scheduled_err;
+#endif
+#if CONFIG_HC_SR04_NRFX_TRIGGER
+    const struct device     *dev;
+    struct k_delayed_work    work;
+    sensor_trigger_handler_t data_ready_handler;
+    struct sensor_trigger    data_ready_trigger;
+    k_tid_t                  data_ready_thread; /* Running data_ready_handler */
+#endif
+#if CONFIG_HC_SR04_NRFX_FETCH_ASYNC
+    struct k_poll_signal    *p_signal; /* Raised when the pending measurement completes */
+#endif
+#if CONFIG_DEVICE_POWER_MANAGEMENT
+    uint32_t                 pm_state;
+#endif
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+    sys_slist_t              listeners;
+#endif
 };
 
 struct hc_sr04_nrfx_cfg {
+    struct hc_sr04_nrfx_unit *p_unit;
     uint32_t trig_pin;
     uint32_t echo_pin;
+    uint32_t scan_order;
+    uint32_t power_pin; /* POWER_PIN_NONE if the module is always powered */
+    bool     has_echo_window;
+    uint32_t echo_window_min_mm;
+    uint32_t echo_window_max_mm;
 };
 
+#if CONFIG_DEVICE_POWER_MANAGEMENT
+#define DATA_SUSPENDED(p_data) (DEVICE_PM_ACTIVE_STATE != (p_data)->pm_state)
+#else
+#define DATA_SUSPENDED(p_data) false
+#endif
+
+static void trigger_schedule(struct hc_sr04_nrfx_unit *p_unit, uint32_t up_count)
+{
+    nrfx_timer_compare(&p_unit->timer,
+                       TIMER_TRIG_UP_CHAN,
+                       (up_count & TIMER_COUNT_MASK),
+                       false);
+    nrfx_timer_compare(&p_unit->timer,
+                       TIMER_TRIG_DOWN_CHAN,
+                       ((up_count + T_TRIG_PULSE_US) & TIMER_COUNT_MASK),
+                       false);
+}
+
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+/* Arms the timeout compare for a TRIG fired at up_count. */
+static void timeout_schedule(struct hc_sr04_nrfx_unit *p_unit, uint32_t up_count)
+{
+    p_unit->timeout_count = ((up_count + p_unit->timeout_span) & TIMER_COUNT_MASK);
+    nrfx_timer_compare(&p_unit->timer, TIMER_TIMEOUT_CHAN, p_unit->timeout_count, false);
+}
+#endif
+
+/*
+ * Longest echo inside HC_SR04_NRFX_ATTR_MAX_RANGE at the current speed of sound.
+ * Called whenever either changes so fetches don't divide.
+ */
+static void max_width_update(struct hc_sr04_nrfx_data *p_data)
+{
+    if (0 == p_data->max_range_um) {
+        p_data->max_width = T_INVALID_PULSE_US;
+    } else {
+        p_data->max_width = (uint32_t)(((uint64_t)p_data->max_range_um << SCALE_SHIFT) /
+                                       p_data->scale);
+    }
+}
+
+/*
+ * An echo whose distance lies outside the device's echo-window-mm is most
+ * likely another sensor's ping. A crosstalk ping ends the echo early, so the
+ * window minimum is what rejects it.
+ */
+static bool echo_is_plausible(const struct hc_sr04_nrfx_cfg *p_cfg,
+                              const struct sensor_value *p_value)
+{
+    uint32_t mm;
+
+    if (!p_cfg->has_echo_window) {
+        return true;
+    }
+    mm = ((p_value->val1 * 1000) + (p_value->val2 / 1000));
+    return ((p_cfg->echo_window_min_mm <= mm) &&
+            (p_cfg->echo_window_max_mm >= mm));
+}
+
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+/* Mirrors the checks of continuous_fetch, whose -ERANGE samples aren't published. */
+static bool sample_is_published(const struct device *dev, uint32_t count)
+{
+    struct sensor_value value;
+
+    const struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    if (!count_to_sensor_value(p_data->scale, count, &value)) {
+        return true;
+    }
+    return ((p_data->max_width >= count) && echo_is_plausible(dev->config, &value));
+}
+#endif
+
+/* Runs in the context that completed the measurement, see hc_sr04_nrfx_listener_add. */
+static void listeners_notify(const struct device *dev, const struct hc_sr04_nrfx_sample *p_sample)
+{
+    struct hc_sr04_nrfx_data     *p_data = dev->data;
+    struct hc_sr04_nrfx_listener *p_listener;
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&p_data->listeners, p_listener, node) {
+        p_listener->handler(dev, p_sample, p_listener->user_data);
+    }
+}
+#endif
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+static void continuous_start(struct hc_sr04_nrfx_unit *p_unit)
+{
+    unsigned int key = irq_lock();
+
+    nrfx_timer_disable(&p_unit->timer);
+    (void) nrfx_ppi_group_disable(p_unit->rising_echo_group);
+    (void) nrfx_ppi_group_disable(p_unit->falling_echo_group);
+    nrfx_timer_clear(&p_unit->timer);
+    trigger_schedule(p_unit, TIMER_TRIG_UP_COUNT);
+
+    p_unit->has_sample  = false;
+    p_unit->latest_time = k_uptime_get_32();
+#if CONFIG_HC_SR04_NRFX_FILTER
+    filter_reset(&p_unit->filter);
+#endif
+
+    nrfx_timer_enable(&p_unit->timer);
+    irq_unlock(key);
+}
+
+#if CONFIG_HC_SR04_NRFX_STREAM || CONFIG_HC_SR04_NRFX_LISTENERS
+static void latest_sample_get(const struct hc_sr04_nrfx_unit *p_unit,
+                              struct hc_sr04_nrfx_sample *p_sample)
+{
+    p_sample->trigger = (p_unit->latest_cycles - k_us_to_cyc_near32(p_unit->latest_age_us));
+    p_sample->width   = p_unit->latest_count;
+}
+#endif
+
+#if CONFIG_HC_SR04_NRFX_STREAM
+static void stream_put(struct hc_sr04_nrfx_unit *p_unit)
+{
+    struct hc_sr04_nrfx_sample sample;
+
+    latest_sample_get(p_unit, &sample);
+
+    /* Only whole samples are written so the consumer never sees a partial one. */
+    if (sizeof(sample) > ring_buf_space_get(p_unit->p_stream)) {
+        p_unit->stream_dropped++;
+        return;
+    }
+    (void) ring_buf_put(p_unit->p_stream, (uint8_t *)&sample, sizeof(sample));
+}
+#endif
+
+static void continuous_capture_handler(struct hc_sr04_nrfx_unit *p_unit)
+{
+    uint32_t trig;
+    uint32_t start;
+    uint32_t end;
+    uint32_t now;
+    uint32_t next;
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+    struct hc_sr04_nrfx_sample sample;
+#endif
+
+    trig  = nrfx_timer_capture_get(&p_unit->timer, TIMER_TRIG_UP_CHAN);
+    start = nrfx_timer_capture_get(&p_unit->timer, TIMER_ECHO_START_CHAN);
+    end   = nrfx_timer_capture_get(&p_unit->timer, TIMER_ECHO_END_CHAN);
+
+    p_unit->latest_count         = ((end - start) & TIMER_COUNT_MASK);
+    p_unit->latest_time          = k_uptime_get_32();
+    p_unit->latest_ts.echo_start = ((start - trig) & TIMER_COUNT_MASK);
+    p_unit->latest_ts.echo_end   = ((end - trig) & TIMER_COUNT_MASK);
+    p_unit->has_sample           = true;
+#if CONFIG_HC_SR04_NRFX_FILTER
+    /* Invalid measurements are the outliers the filter is there to reject. */
+    if (count_is_valid(p_unit->latest_count)) {
+        filter_add(&p_unit->filter, p_unit->latest_count);
+    }
+#endif
+
+    /*
+     * Keep the nominal rate relative to the previous TRIG but never fire before the
+     * spurious pulse that follows an invalid measurement has passed. The start
+     * capture register has been read so it can be reused to sample the counter.
+     */
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS_ADAPTIVE
+    /* A near target's reverberations have faded long before the nominal period. */
+    if (count_is_valid(p_unit->latest_count)) {
+        next = (trig + MIN(MAX((ECHO_DECAY_FACTOR * p_unit->latest_ts.echo_end),
+                               T_MIN_PERIOD_US),
+                           T_PERIOD_US));
+    } else {
+        next = (trig + T_PERIOD_US);
+    }
+#else
+    next = (trig + T_PERIOD_US);
+#endif
+    if (timer_count_before(next, (end + T_RETRIGGER_HOLDOFF_US))) {
+        next = (end + T_RETRIGGER_HOLDOFF_US);
+    }
+    now = nrfx_timer_capture(&p_unit->timer, TIMER_ECHO_START_CHAN);
+    /* The conversion to cycles is left to the thread that fetches the sample. */
+    p_unit->latest_cycles = k_cycle_get_32();
+    p_unit->latest_age_us = ((now - trig) & TIMER_COUNT_MASK);
+    if (timer_count_before(next, (now + T_RETRIGGER_LEAD_US))) {
+        next = (now + T_RETRIGGER_LEAD_US);
+    }
+    trigger_schedule(p_unit, next);
+
+#if CONFIG_HC_SR04_NRFX_STREAM
+    if (NULL != p_unit->p_stream) {
+        stream_put(p_unit);
+    }
+#endif
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+    if (sample_is_published(p_unit->active_dev, p_unit->latest_count)) {
+        latest_sample_get(p_unit, &sample);
+        listeners_notify(p_unit->active_dev, &sample);
+    }
+#endif
+}
+#endif
+
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+static uint32_t sensor_ready_delay_get(struct hc_sr04_nrfx_unit *p_unit)
+{
+    uint32_t start = nrfx_timer_capture_get(&p_unit->timer, TIMER_ECHO_START_CHAN);
+
+    /*
+     * The sensor ignores TRIG until the invalid pulse and its trailing spurious
+     * pulse are over. A zero start capture means the echo never went high.
+     */
+    if (0 == start) {
+        return T_RETRIGGER_HOLDOFF_US;
+    }
+    return (start + T_INVALID_ECHO_US + T_RETRIGGER_HOLDOFF_US - p_unit->timeout_count);
+}
+#endif
+
+static uint32_t capture_width_get(struct hc_sr04_nrfx_unit *p_unit)
+{
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    if (p_unit->out_of_range) {
+        return HC_SR04_NRFX_WIDTH_OUT_OF_RANGE;
+    }
+#endif
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    /* The start capture register is reused by continuous_capture_handler(). */
+    return p_unit->latest_count;
+#else
+    return ((nrfx_timer_capture_get(&p_unit->timer, TIMER_ECHO_END_CHAN) -
+             nrfx_timer_capture_get(&p_unit->timer, TIMER_ECHO_START_CHAN)) &
+            TIMER_COUNT_MASK);
+#endif
+}
+
+/* Returns true if the thread waiting on fetch_sem should be woken up. */
+static bool burst_capture_handler(struct hc_sr04_nrfx_unit *p_unit)
+{
+    if (0 == p_unit->burst_len) {
+        return !IS_ENABLED(CONFIG_HC_SR04_NRFX_CONTINUOUS);
+    }
+
+    p_unit->p_burst[p_unit->burst_idx++] = capture_width_get(p_unit);
+    if (p_unit->burst_idx < p_unit->burst_len) {
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+        if (p_unit->out_of_range) {
+            /* PPI has stopped the TIMER at the timeout compare without clearing it. */
+            uint32_t up_count = (p_unit->timeout_count + sensor_ready_delay_get(p_unit));
+
+            p_unit->out_of_range = false;
+            trigger_schedule(p_unit, up_count);
+            timeout_schedule(p_unit, up_count);
+            nrfx_timer_compare(&p_unit->timer, TIMER_ECHO_START_CHAN, 0, false);
+            nrf_timer_task_trigger(p_unit->timer.p_reg, NRF_TIMER_TASK_START);
+            return false;
+        }
+        nrfx_timer_compare(&p_unit->timer, TIMER_ECHO_START_CHAN, 0, false);
+        timeout_schedule(p_unit, TIMER_BURST_UP_COUNT);
+#endif
+        /* PPI has stopped and cleared the TIMER. Restart it to fire the next TRIG. */
+        trigger_schedule(p_unit, TIMER_BURST_UP_COUNT);
+        nrf_timer_task_trigger(p_unit->timer.p_reg, NRF_TIMER_TASK_START);
+#endif
+        return false;
+    }
+    p_unit->burst_len = 0;
+    return true;
+}
+
+#if CONFIG_HC_SR04_NRFX_TRIGGER
+static void trigger_work_handler(struct k_work *work);
+
+static void trigger_notify(struct hc_sr04_nrfx_unit *p_unit)
+{
+    struct hc_sr04_nrfx_data *p_data = p_unit->active_dev->data;
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    if (NULL == p_data->data_ready_handler) {
+        return;
+    }
+#else
+    if (!p_unit->async) {
+        return;
+    }
+#endif
+    (void) k_delayed_work_submit(&p_data->work, K_NO_WAIT);
+}
+#endif
 
 static void egu_handler(uint8_t event_idx, void * p_context)
 {
-    k_sem_give(&m_shared_resources.fetch_sem);
+    struct hc_sr04_nrfx_unit *p_unit = p_context;
+
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    if (EGU_TIMEOUT_EVENT_POS == event_idx) {
+        p_unit->out_of_range = true;
+    }
+#endif
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    continuous_capture_handler(p_unit);
+#endif
+    if (burst_capture_handler(p_unit)) {
+        k_sem_give(&p_unit->fetch_sem);
+    }
+
+#if CONFIG_HC_SR04_NRFX_TRIGGER
+    trigger_notify(p_unit);
+#endif
 }
 
 static void timer_handler(nrf_timer_event_t event_type, void * p_context)
@@ -82,112 +575,267 @@ static void timer_handler(nrf_timer_event_t event_type, void * p_context)
      */
 }
 
-static void gpiote_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+#if CONFIG_GPIO
+/*
+ * gpio_nrfx owns the GPIOTE interrupt and hands out channels for edge
+ * interrupts from a private mask, without going through nrfx_gpiote. A channel
+ * is therefore reserved by asking gpio_nrfx for an edge interrupt on the pin
+ * and looking up the channel it configured for it. That channel's interrupt
+ * is disabled again so gpio_nrfx never sees the events while the driver uses
+ * it, and it is handed back by disabling the pin interrupt.
+ */
+static nrfx_err_t gpiote_channel_alloc(uint32_t pin, uint8_t *p_channel)
 {
-    /* 
-     * Required by the NRFX driver but never called. In fact, it can't be
-     * called because it's not registered with IRQ_CONNECT.
-     */
+    const struct device *port = m_shared_resources.gpio_ports[pin >> 5];
+    unsigned int         key;
+    uint8_t              i;
+    int                  err;
+
+    if (NULL == port) {
+        return NRFX_ERROR_INVALID_PARAM;
+    }
+
+    err = gpio_pin_configure(port, (pin & 0x1F), GPIO_INPUT);
+    if (0 == err) {
+        err = gpio_pin_interrupt_configure(port, (pin & 0x1F), GPIO_INT_EDGE_BOTH);
+    }
+    if (0 != err) {
+        return NRFX_ERROR_NO_MEM;
+    }
+
+    key = irq_lock();
+    for (i = 0; i < GPIOTE_CH_NUM; i++) {
+        if ((GPIOTE_CONFIG_MODE_Event ==
+                ((NRF_GPIOTE->CONFIG[i] & GPIOTE_CONFIG_MODE_Msk) >> GPIOTE_CONFIG_MODE_Pos)) &&
+            (pin == nrf_gpiote_event_pin_get(NRF_GPIOTE, i))) {
+            nrf_gpiote_int_disable(NRF_GPIOTE, BIT(i));
+            m_shared_resources.gpiote_used  |= BIT(i);
+            m_shared_resources.gpiote_pins[i] = pin;
+            irq_unlock(key);
+            *p_channel = i;
+            return NRFX_SUCCESS;
+        }
+    }
+    irq_unlock(key);
+
+    /* Level interrupts don't take a channel; gpio_nrfx had none left for an edge. */
+    (void) gpio_pin_interrupt_configure(port, (pin & 0x1F), GPIO_INT_DISABLE);
+    return NRFX_ERROR_NO_MEM;
 }
 
-static nrfx_err_t gpiote_pins_init(uint32_t trig_pin, uint32_t echo_pin)
+static uint8_t gpiote_channel_get(uint32_t pin)
 {
-    nrfx_err_t nrfx_err = NRFX_SUCCESS;
+    uint8_t i;
+
+    for (i = 0; i < GPIOTE_CH_NUM; i++) {
+        if ((m_shared_resources.gpiote_used & BIT(i)) &&
+            (pin == m_shared_resources.gpiote_pins[i])) {
+            break;
+        }
+    }
+    __ASSERT_NO_MSG(GPIOTE_CH_NUM != i);
+    return i;
+}
+
+static void gpiote_channel_free(uint32_t pin)
+{
+    const struct device *port    = m_shared_resources.gpio_ports[pin >> 5];
+    unsigned int         key;
+    uint8_t              channel = gpiote_channel_get(pin);
+
+    /* gpio_nrfx only releases a channel that still has its interrupt enabled. */
+    key = irq_lock();
+    nrf_gpiote_event_clear(NRF_GPIOTE, nrf_gpiote_in_event_get(channel));
+    nrf_gpiote_int_enable(NRF_GPIOTE, BIT(channel));
+    (void) gpio_pin_interrupt_configure(port, (pin & 0x1F), GPIO_INT_DISABLE);
+    m_shared_resources.gpiote_used &= ~BIT(channel);
+    irq_unlock(key);
+
+    nrf_gpio_cfg_default(pin);
+}
+
+static nrfx_err_t gpiote_in_init(uint32_t pin)
+{
+    nrfx_err_t nrfx_err;
+    uint8_t    channel;
 
-    nrfx_err = nrfx_gpiote_in_init(echo_pin, &m_shared_resources.echo_in, gpiote_handler);
+    nrfx_err = gpiote_channel_alloc(pin, &channel);
     if (NRFX_SUCCESS != nrfx_err) {
         return nrfx_err;
     }
-    nrfx_err = nrfx_gpiote_out_init(trig_pin, &m_shared_resources.trig_out);
+    nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_NOPULL);
+    nrf_gpiote_event_configure(NRF_GPIOTE, channel, pin, NRF_GPIOTE_POLARITY_TOGGLE);
+    return NRFX_SUCCESS;
+}
+
+static nrfx_err_t gpiote_out_init(uint32_t pin)
+{
+    nrfx_err_t nrfx_err;
+    uint8_t    channel;
+
+    nrfx_err = gpiote_channel_alloc(pin, &channel);
     if (NRFX_SUCCESS != nrfx_err) {
         return nrfx_err;
     }
+    nrf_gpio_pin_clear(pin);
+    nrf_gpio_cfg_output(pin);
+    nrf_gpiote_task_configure(NRF_GPIOTE, channel, pin,
+                              NRF_GPIOTE_POLARITY_TOGGLE, NRF_GPIOTE_INITIAL_VALUE_LOW);
+    return NRFX_SUCCESS;
+}
+
+#define gpiote_in_uninit(pin)  gpiote_channel_free(pin)
+#define gpiote_out_uninit(pin) gpiote_channel_free(pin)
+
+static void gpiote_in_event_enable(uint32_t pin)
+{
+    nrf_gpiote_event_enable(NRF_GPIOTE, gpiote_channel_get(pin));
+}
+
+static void gpiote_out_task_enable(uint32_t pin)
+{
+    nrf_gpiote_task_enable(NRF_GPIOTE, gpiote_channel_get(pin));
+}
+
+static void gpiote_in_event_disable(uint32_t pin)
+{
+    nrf_gpiote_event_disable(NRF_GPIOTE, gpiote_channel_get(pin));
+}
+
+static uint32_t gpiote_in_event_addr_get(uint32_t pin)
+{
+    return nrf_gpiote_event_address_get(NRF_GPIOTE,
+                                        nrf_gpiote_in_event_get(gpiote_channel_get(pin)));
+}
+
+static uint32_t gpiote_out_task_addr_get(uint32_t pin)
+{
+    return nrf_gpiote_task_address_get(NRF_GPIOTE,
+                                       nrf_gpiote_out_task_get(gpiote_channel_get(pin)));
+}
+#else
+static void gpiote_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    /* 
+     * Required by the NRFX driver but never called. In fact, it can't be
+     * called because it's not registered with IRQ_CONNECT.
+     */
+}
+
+#define gpiote_in_init(pin)           nrfx_gpiote_in_init((pin), &m_shared_resources.echo_in, gpiote_handler)
+#define gpiote_out_init(pin)          nrfx_gpiote_out_init((pin), &m_shared_resources.trig_out)
+#define gpiote_in_uninit(pin)         nrfx_gpiote_in_uninit(pin)
+#define gpiote_out_uninit(pin)        nrfx_gpiote_out_uninit(pin)
+#define gpiote_in_event_enable(pin)   nrfx_gpiote_in_event_enable((pin), false)
+#define gpiote_out_task_enable(pin)   nrfx_gpiote_out_task_enable(pin)
+#define gpiote_in_event_disable(pin)  nrfx_gpiote_in_event_disable(pin)
+#define gpiote_in_event_addr_get(pin) nrfx_gpiote_in_event_addr_get(pin)
+#define gpiote_out_task_addr_get(pin) nrfx_gpiote_out_task_addr_get(pin)
+#endif
 
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS
+static void ppi_endpoints_setup(struct hc_sr04_nrfx_unit *p_unit,
+                                uint32_t trig_pin,
+                                uint32_t echo_pin)
+{
     nrf_ppi_task_endpoint_setup(NRF_PPI,
-        m_shared_resources.trig_up_channel,
-        nrfx_gpiote_out_task_addr_get(trig_pin));
+        p_unit->trig_up_channel,
+        gpiote_out_task_addr_get(trig_pin));
     nrf_ppi_task_endpoint_setup(NRF_PPI,
-        m_shared_resources.trig_down_channel,
-        nrfx_gpiote_out_task_addr_get(trig_pin));
+        p_unit->trig_down_channel,
+        gpiote_out_task_addr_get(trig_pin));
     nrf_ppi_event_endpoint_setup(NRF_PPI,
-        m_shared_resources.timer_start_channel,
-        nrfx_gpiote_in_event_addr_get(echo_pin));
+        p_unit->timer_start_channel,
+        gpiote_in_event_addr_get(echo_pin));
     nrf_ppi_event_endpoint_setup(NRF_PPI,
-        m_shared_resources.rising_group_channel,
-        nrfx_gpiote_in_event_addr_get(echo_pin));
+        p_unit->rising_group_channel,
+        gpiote_in_event_addr_get(echo_pin));
     nrf_ppi_event_endpoint_setup(NRF_PPI,
-        m_shared_resources.capture_stop_channel,
-        nrfx_gpiote_in_event_addr_get(echo_pin));
+        p_unit->capture_stop_channel,
+        gpiote_in_event_addr_get(echo_pin));
     nrf_ppi_event_endpoint_setup(NRF_PPI,
-        m_shared_resources.clear_int_channel,
-        nrfx_gpiote_in_event_addr_get(echo_pin));
+        p_unit->clear_int_channel,
+        gpiote_in_event_addr_get(echo_pin));
     nrf_ppi_event_endpoint_setup(NRF_PPI,
-        m_shared_resources.falling_group_channel,
-        nrfx_gpiote_in_event_addr_get(echo_pin));
+        p_unit->falling_group_channel,
+        gpiote_in_event_addr_get(echo_pin));
+}
+
+static nrfx_err_t gpiote_pins_init(struct hc_sr04_nrfx_unit *p_unit,
+                                   uint32_t trig_pin,
+                                   uint32_t echo_pin)
+{
+    nrfx_err_t nrfx_err = NRFX_SUCCESS;
+
+    nrfx_err = gpiote_in_init(echo_pin);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return nrfx_err;
+    }
+    nrfx_err = gpiote_out_init(trig_pin);
+    if (NRFX_SUCCESS != nrfx_err) {
+        return nrfx_err;
+    }
+
+    ppi_endpoints_setup(p_unit, trig_pin, echo_pin);
 
-    nrfx_gpiote_in_event_enable(echo_pin, false);
-    nrfx_gpiote_out_task_enable(trig_pin);
+    gpiote_in_event_enable(echo_pin);
+    gpiote_out_task_enable(trig_pin);
 
     return nrfx_err;
 }
+#endif
 
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS && !CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
 static void gpiote_pins_uninit(uint32_t trig_pin, uint32_t echo_pin)
 {
-    nrfx_gpiote_in_uninit(echo_pin);
-    nrfx_gpiote_out_uninit(trig_pin);
+    gpiote_in_uninit(echo_pin);
+    gpiote_out_uninit(trig_pin);
 }
+#endif
 
-static nrfx_err_t timer_init(void)
+static nrfx_err_t timer_init(struct hc_sr04_nrfx_unit *p_unit)
 {
     nrfx_err_t err;
 
-    m_shared_resources.timer.p_reg       = NRFX_CONCAT_2(NRF_TIMER, CONFIG_HC_SR04_NRFX_TIMER);
-    m_shared_resources.timer.instance_id = NRFX_CONCAT_3(NRFX_TIMER,
-                                                         CONFIG_HC_SR04_NRFX_TIMER,
-                                                         _INST_IDX);
-    m_shared_resources.timer.cc_channel_count = NRF_TIMER_CC_CHANNEL_COUNT(CONFIG_HC_SR04_NRFX_TIMER);
-
     nrfx_timer_config_t cfg = NRFX_TIMER_DEFAULT_CONFIG;
     cfg.bit_width           = NRF_TIMER_BIT_WIDTH_24,
     cfg.frequency           = NRF_TIMER_FREQ_1MHz;
-    cfg.interrupt_priority  = DT_IRQ(DT_NODELABEL(NRFX_CONCAT_2(timer,
-                                                                CONFIG_HC_SR04_NRFX_TIMER)),
-                                                                priority);
+    cfg.interrupt_priority  = p_unit->timer_irq_priority;
 
-    err = nrfx_timer_init(&m_shared_resources.timer, &cfg, timer_handler);
+    err = nrfx_timer_init(&p_unit->timer, &cfg, timer_handler);
     if (NRFX_SUCCESS != err) {
         return err;
     }
 
-    nrfx_timer_compare(&m_shared_resources.timer,TIMER_TRIG_UP_CHAN,  TIMER_TRIG_UP_COUNT,  false);
-    nrfx_timer_compare(&m_shared_resources.timer,TIMER_TRIG_DOWN_CHAN,TIMER_TRIG_DOWN_COUNT,false);
+    nrfx_timer_compare(&p_unit->timer,TIMER_TRIG_UP_CHAN,  TIMER_TRIG_UP_COUNT,  false);
+    nrfx_timer_compare(&p_unit->timer,TIMER_TRIG_DOWN_CHAN,TIMER_TRIG_DOWN_COUNT,false);
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    p_unit->timeout_span = (TIMER_TIMEOUT_COUNT - TIMER_TRIG_UP_COUNT);
+    timeout_schedule(p_unit, TIMER_TRIG_UP_COUNT);
+#endif
     return NRFX_SUCCESS;
 }
 
-static nrfx_err_t egu_init(NRF_EGU_Type ** p_egu)
+static nrfx_err_t egu_init(struct hc_sr04_nrfx_unit *p_unit)
 {
     nrfx_err_t err;
 
-    IRQ_CONNECT(DT_IRQN(DT_NODELABEL(NRFX_CONCAT_2(egu, CONFIG_HC_SR04_NRFX_EGU))),
-            DT_IRQ(DT_NODELABEL(NRFX_CONCAT_2(egu, CONFIG_HC_SR04_NRFX_EGU)), priority),
-            nrfx_isr,
-            NRFX_CONCAT_3(nrfx_egu_, CONFIG_HC_SR04_NRFX_EGU, _irq_handler),
-            0);
+    p_unit->irq_connect();
 
-    nrfx_egu_t egu = NRFX_EGU_INSTANCE(CONFIG_HC_SR04_NRFX_EGU);
-
-    *p_egu = egu.p_reg;
-
-    err = nrfx_egu_init(&egu, 0, egu_handler, NULL);
+    err = nrfx_egu_init(&p_unit->egu, 0, egu_handler, p_unit);
     if (NRFX_SUCCESS != err) {
         return err;
     }
 
-    nrfx_egu_int_enable(&egu, (1 << EGU_EVENT_POS));
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    nrfx_egu_int_enable(&p_unit->egu, ((1 << EGU_EVENT_POS) | (1 << EGU_TIMEOUT_EVENT_POS)));
+#else
+    nrfx_egu_int_enable(&p_unit->egu, (1 << EGU_EVENT_POS));
+#endif
     return NRFX_SUCCESS;
 }
 
-static nrfx_err_t ppi_init(NRF_EGU_Type * p_egu, uint32_t echo_pin, uint32_t trig_pin)
+static nrfx_err_t ppi_init(struct hc_sr04_nrfx_unit *p_unit, uint32_t echo_pin, uint32_t trig_pin)
 {
     nrfx_err_t err;
     nrf_ppi_channel_group_t rising_echo_group;
@@ -201,44 +849,46 @@ static nrfx_err_t ppi_init(NRF_EGU_Type * p_egu, uint32_t echo_pin, uint32_t tri
     if (NRFX_SUCCESS != err) {
         return err;
     }
+    p_unit->rising_echo_group  = rising_echo_group;
+    p_unit->falling_echo_group = falling_echo_group;
 
     /*
      * CC[TIMER_TRIG_UP_CHAN] event   -> Trig toggle high
      * CC[TIMER_TRIG_DOWN_CHAN] event -> Trig toggle low
      *                                -> Enable rising edge group
      */
-    err = nrfx_ppi_channel_alloc(&m_shared_resources.trig_up_channel);
+    err = nrfx_ppi_channel_alloc(&p_unit->trig_up_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_alloc(&m_shared_resources.trig_down_channel);
+    err = nrfx_ppi_channel_alloc(&p_unit->trig_down_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_assign(m_shared_resources.trig_up_channel,
-                nrfx_timer_compare_event_address_get(&m_shared_resources.timer,
+    err = nrfx_ppi_channel_assign(p_unit->trig_up_channel,
+                nrfx_timer_compare_event_address_get(&p_unit->timer,
                                                      TIMER_TRIG_UP_CHAN),
-                nrfx_gpiote_out_task_addr_get(trig_pin));
+                gpiote_out_task_addr_get(trig_pin));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_assign(m_shared_resources.trig_down_channel,
-                nrfx_timer_compare_event_address_get(&m_shared_resources.timer,
+    err = nrfx_ppi_channel_assign(p_unit->trig_down_channel,
+                nrfx_timer_compare_event_address_get(&p_unit->timer,
                                                      TIMER_TRIG_DOWN_CHAN),
-                nrfx_gpiote_out_task_addr_get(trig_pin));
+                gpiote_out_task_addr_get(trig_pin));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_fork_assign(m_shared_resources.trig_down_channel,
+    err = nrfx_ppi_channel_fork_assign(p_unit->trig_down_channel,
                 nrfx_ppi_task_addr_group_enable_get(rising_echo_group));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_enable(m_shared_resources.trig_up_channel);
+    err = nrfx_ppi_channel_enable(p_unit->trig_up_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_enable(m_shared_resources.trig_down_channel);
+    err = nrfx_ppi_channel_enable(p_unit->trig_down_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
@@ -248,47 +898,47 @@ static nrfx_err_t ppi_init(NRF_EGU_Type * p_egu, uint32_t echo_pin, uint32_t tri
      *                   -> Disable rising edge group
      *                   -> Enable falling edge group
      */
-    err = nrfx_ppi_channel_alloc(&m_shared_resources.timer_start_channel);
+    err = nrfx_ppi_channel_alloc(&p_unit->timer_start_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_alloc(&m_shared_resources.rising_group_channel);
+    err = nrfx_ppi_channel_alloc(&p_unit->rising_group_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_assign(m_shared_resources.timer_start_channel,
-                nrfx_gpiote_in_event_addr_get(echo_pin),
-                nrfx_timer_capture_task_address_get(&m_shared_resources.timer,
+    err = nrfx_ppi_channel_assign(p_unit->timer_start_channel,
+                gpiote_in_event_addr_get(echo_pin),
+                nrfx_timer_capture_task_address_get(&p_unit->timer,
                                                     TIMER_ECHO_START_CHAN));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_assign(m_shared_resources.rising_group_channel,
-                nrfx_gpiote_in_event_addr_get(echo_pin),
+    err = nrfx_ppi_channel_assign(p_unit->rising_group_channel,
+                gpiote_in_event_addr_get(echo_pin),
                 nrfx_ppi_task_addr_group_disable_get(rising_echo_group));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_fork_assign(m_shared_resources.rising_group_channel,
+    err = nrfx_ppi_channel_fork_assign(p_unit->rising_group_channel,
                 nrfx_ppi_task_addr_group_enable_get(falling_echo_group));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_include_in_group(m_shared_resources.timer_start_channel,
+    err = nrfx_ppi_channel_include_in_group(p_unit->timer_start_channel,
                                             rising_echo_group);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_include_in_group(m_shared_resources.rising_group_channel,
+    err = nrfx_ppi_channel_include_in_group(p_unit->rising_group_channel,
                                             rising_echo_group);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_enable(m_shared_resources.timer_start_channel);
+    err = nrfx_ppi_channel_enable(p_unit->timer_start_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_enable(m_shared_resources.rising_group_channel);
+    err = nrfx_ppi_channel_enable(p_unit->rising_group_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
@@ -299,76 +949,81 @@ static nrfx_err_t ppi_init(NRF_EGU_Type * p_egu, uint32_t echo_pin, uint32_t tri
 
     /*
      * Falling echo event -> Capture TIMER to CC[TIMER_ECHO_END_CHAN]
-     *                    -> Stop TIMER
-     *                    -> Clear TIMER
+     *                    -> Stop TIMER (not in continuous mode)
+     *                    -> Clear TIMER (not in continuous mode)
      *                    -> Trigger EGU interrupt
      *                    -> Disable falling edge group
      */
-    err = nrfx_ppi_channel_alloc(&m_shared_resources.capture_stop_channel);
+    err = nrfx_ppi_channel_alloc(&p_unit->capture_stop_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_alloc(&m_shared_resources.clear_int_channel);
+    err = nrfx_ppi_channel_alloc(&p_unit->clear_int_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_alloc(&m_shared_resources.falling_group_channel);
+    err = nrfx_ppi_channel_alloc(&p_unit->falling_group_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_assign(m_shared_resources.capture_stop_channel,
-                nrfx_gpiote_in_event_addr_get(echo_pin),
-                nrfx_timer_capture_task_address_get(&m_shared_resources.timer,
+    err = nrfx_ppi_channel_assign(p_unit->capture_stop_channel,
+                gpiote_in_event_addr_get(echo_pin),
+                nrfx_timer_capture_task_address_get(&p_unit->timer,
                                                     TIMER_ECHO_END_CHAN));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_fork_assign(m_shared_resources.capture_stop_channel,
-                nrfx_timer_task_address_get(&m_shared_resources.timer, NRF_TIMER_TASK_STOP));
-    if (NRFX_SUCCESS != err) {
-        return err;
+    if (!IS_ENABLED(CONFIG_HC_SR04_NRFX_CONTINUOUS)) {
+        err = nrfx_ppi_channel_fork_assign(p_unit->capture_stop_channel,
+                    nrfx_timer_task_address_get(&p_unit->timer, NRF_TIMER_TASK_STOP));
+        if (NRFX_SUCCESS != err) {
+            return err;
+        }
     }
-    err = nrfx_ppi_channel_assign(m_shared_resources.clear_int_channel,
-                nrfx_gpiote_in_event_addr_get(echo_pin),
-                nrf_egu_task_address_get(p_egu, NRFX_CONCAT_2(NRF_EGU_TASK_TRIGGER,EGU_EVENT_POS)));
+    err = nrfx_ppi_channel_assign(p_unit->clear_int_channel,
+                gpiote_in_event_addr_get(echo_pin),
+                nrf_egu_task_address_get(p_unit->egu.p_reg,
+                                         NRFX_CONCAT_2(NRF_EGU_TASK_TRIGGER,EGU_EVENT_POS)));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_fork_assign(m_shared_resources.clear_int_channel,
-                nrfx_timer_task_address_get(&m_shared_resources.timer, NRF_TIMER_TASK_CLEAR));
-    if (NRFX_SUCCESS != err) {
-        return err;
+    if (!IS_ENABLED(CONFIG_HC_SR04_NRFX_CONTINUOUS)) {
+        err = nrfx_ppi_channel_fork_assign(p_unit->clear_int_channel,
+                    nrfx_timer_task_address_get(&p_unit->timer, NRF_TIMER_TASK_CLEAR));
+        if (NRFX_SUCCESS != err) {
+            return err;
+        }
     }
-    err = nrfx_ppi_channel_assign(m_shared_resources.falling_group_channel,
-                nrfx_gpiote_in_event_addr_get(echo_pin),
+    err = nrfx_ppi_channel_assign(p_unit->falling_group_channel,
+                gpiote_in_event_addr_get(echo_pin),
                 nrfx_ppi_task_addr_group_disable_get(falling_echo_group));
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_include_in_group(m_shared_resources.capture_stop_channel,
+    err = nrfx_ppi_channel_include_in_group(p_unit->capture_stop_channel,
                                             falling_echo_group);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_include_in_group(m_shared_resources.clear_int_channel,
+    err = nrfx_ppi_channel_include_in_group(p_unit->clear_int_channel,
                                             falling_echo_group);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_include_in_group(m_shared_resources.falling_group_channel,
+    err = nrfx_ppi_channel_include_in_group(p_unit->falling_group_channel,
                                             falling_echo_group);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_enable(m_shared_resources.capture_stop_channel);
+    err = nrfx_ppi_channel_enable(p_unit->capture_stop_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_enable(m_shared_resources.clear_int_channel);
+    err = nrfx_ppi_channel_enable(p_unit->clear_int_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = nrfx_ppi_channel_enable(m_shared_resources.falling_group_channel);
+    err = nrfx_ppi_channel_enable(p_unit->falling_group_channel);
     if (NRFX_SUCCESS != err) {
         return err;
     }
@@ -376,39 +1031,97 @@ static nrfx_err_t ppi_init(NRF_EGU_Type * p_egu, uint32_t echo_pin, uint32_t tri
     if (NRFX_SUCCESS != err) {
         return err;
     }
-    return NRFX_SUCCESS;
-}
-
-static int hc_sr04_nrfx_init(const struct device *dev)
-{
-    int           err;
-    nrfx_err_t    nrfx_err;
-    NRF_EGU_Type *p_egu;
-
-    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
-    struct hc_sr04_nrfx_data      *p_data = dev->data;
-
-    p_data->sensor_value.val1 = 0;
-    p_data->sensor_value.val2 = 0;
-
-    if (m_shared_resources.ready) {
-        /* Already initialized */
-        return 0;
-    }
 
-    err = k_sem_init(&m_shared_resources.fetch_sem, 0, 1);
-    if (0 != err) {
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    /*
+     * CC[TIMER_TIMEOUT_CHAN] event -> Stop TIMER
+     *                              -> Trigger EGU timeout interrupt
+     *                              -> Disable rising edge group
+     *                              -> Disable falling edge group
+     */
+    err = nrfx_ppi_channel_alloc(&p_unit->timeout_int_channel);
+    if (NRFX_SUCCESS != err) {
         return err;
     }
-    err = k_mutex_init(&m_shared_resources.mutex);
-    if (0 != err) {
+    err = nrfx_ppi_channel_alloc(&p_unit->timeout_group_channel);
+    if (NRFX_SUCCESS != err) {
         return err;
     }
+    err = nrfx_ppi_channel_assign(p_unit->timeout_int_channel,
+                nrfx_timer_compare_event_address_get(&p_unit->timer,
+                                                     TIMER_TIMEOUT_CHAN),
+                nrfx_timer_task_address_get(&p_unit->timer, NRF_TIMER_TASK_STOP));
+    if (NRFX_SUCCESS != err) {
+        return err;
+    }
+    err = nrfx_ppi_channel_fork_assign(p_unit->timeout_int_channel,
+                nrf_egu_task_address_get(p_unit->egu.p_reg,
+                                         NRFX_CONCAT_2(NRF_EGU_TASK_TRIGGER,EGU_TIMEOUT_EVENT_POS)));
+    if (NRFX_SUCCESS != err) {
+        return err;
+    }
+    err = nrfx_ppi_channel_assign(p_unit->timeout_group_channel,
+                nrfx_timer_compare_event_address_get(&p_unit->timer,
+                                                     TIMER_TIMEOUT_CHAN),
+                nrfx_ppi_task_addr_group_disable_get(rising_echo_group));
+    if (NRFX_SUCCESS != err) {
+        return err;
+    }
+    err = nrfx_ppi_channel_fork_assign(p_unit->timeout_group_channel,
+                nrfx_ppi_task_addr_group_disable_get(falling_echo_group));
+    if (NRFX_SUCCESS != err) {
+        return err;
+    }
+    err = nrfx_ppi_channel_enable(p_unit->timeout_int_channel);
+    if (NRFX_SUCCESS != err) {
+        return err;
+    }
+    err = nrfx_ppi_channel_enable(p_unit->timeout_group_channel);
+    if (NRFX_SUCCESS != err) {
+        return err;
+    }
+#endif
+    return NRFX_SUCCESS;
+}
+
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+static inline uint32_t scan_order_get(const struct device *dev)
+{
+    const struct hc_sr04_nrfx_cfg *p_cfg = dev->config;
+
+    return p_cfg->scan_order;
+}
+
+static void scheduler_register(const struct device *dev)
+{
+    size_t i = m_shared_resources.sched_count;
+
+    /* Insertion sort keeps instances with equal scan-order in devicetree order. */
+    while ((0 < i) &&
+           (scan_order_get(dev) < scan_order_get(m_shared_resources.sched_devs[i - 1]))) {
+        m_shared_resources.sched_devs[i] = m_shared_resources.sched_devs[i - 1];
+        i--;
+    }
+    m_shared_resources.sched_devs[i] = dev;
+    m_shared_resources.sched_count++;
+}
+#endif
+
+static nrfx_err_t gpiote_init(void)
+{
+#if !CONFIG_GPIO
+    nrfx_err_t nrfx_err;
+#endif
+
+    if (m_shared_resources.ready) {
+        return NRFX_SUCCESS;
+    }
 
+#if !CONFIG_GPIO
     /* NOTE: This interrupt priority is not used. */
     nrfx_err = nrfx_gpiote_init(0);
     if (NRFX_SUCCESS != nrfx_err) {
-        goto ERR_EXIT;
+        return nrfx_err;
     }
 
     m_shared_resources.echo_in.sense           = NRF_GPIOTE_POLARITY_TOGGLE;
@@ -417,144 +1130,1354 @@ static int hc_sr04_nrfx_init(const struct device *dev)
     m_shared_resources.echo_in.hi_accuracy     = true;
     m_shared_resources.echo_in.skip_gpio_setup = false;
 
-    m_shared_resources.trig_out.action     = NRF_GPIOTE_POLARITY_TOGGLE;
-    m_shared_resources.trig_out.init_state = false;
-    m_shared_resources.trig_out.task_pin   = true;
+    m_shared_resources.trig_out.action     = NRF_GPIOTE_POLARITY_TOGGLE;
+    m_shared_resources.trig_out.init_state = false;
+    m_shared_resources.trig_out.task_pin   = true;
+#else
+    m_shared_resources.gpio_ports[0] = device_get_binding(DT_LABEL(DT_NODELABEL(gpio0)));
+#if DT_NODE_HAS_STATUS(DT_NODELABEL(gpio1), okay)
+    m_shared_resources.gpio_ports[1] = device_get_binding(DT_LABEL(DT_NODELABEL(gpio1)));
+#endif
+#endif
+
+    m_shared_resources.ready = true;
+    return NRFX_SUCCESS;
+}
+
+static int hc_sr04_nrfx_init(const struct device *dev)
+{
+    int        err;
+    nrfx_err_t nrfx_err;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_data      *p_data = dev->data;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    p_data->sensor_value.val1 = 0;
+    p_data->sensor_value.val2 = 0;
+    p_data->scale             = SPEED_TO_SCALE(METERS_PER_SEC * 1000);
+    max_width_update(p_data);
+#if CONFIG_DEVICE_POWER_MANAGEMENT
+    p_data->pm_state          = DEVICE_PM_ACTIVE_STATE;
+#endif
+
+    if (POWER_PIN_NONE != p_cfg->power_pin) {
+        nrf_gpio_pin_set(p_cfg->power_pin);
+        nrf_gpio_cfg_output(p_cfg->power_pin);
+        /* Waited out by the first fetch instead of holding up the boot. */
+        p_data->ready_at = (k_uptime_get() + CONFIG_HC_SR04_NRFX_POWER_ON_DELAY_MS);
+    }
+
+#if CONFIG_HC_SR04_NRFX_STATS
+    stats_init(&p_data->stats.s_hdr,
+               STATS_SIZE_32,
+               ((sizeof(p_data->stats) - sizeof(struct stats_hdr)) / sizeof(uint32_t)),
+               STATS_NAME_INIT_PARMS(hc_sr04_nrfx));
+    (void) stats_register(dev->name, &p_data->stats.s_hdr);
+#endif
+
+#if CONFIG_HC_SR04_NRFX_TRIGGER
+    p_data->dev = dev;
+    k_delayed_work_init(&p_data->work, trigger_work_handler);
+#endif
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+    sys_slist_init(&p_data->listeners);
+#endif
+
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+    p_data->scheduled_err = -EIO; /* Until the first sweep has reached this instance */
+#endif
+
+    nrfx_err = gpiote_init();
+    if (NRFX_SUCCESS != nrfx_err) {
+        goto ERR_EXIT;
+    }
+
+    if (p_unit->ready) {
+        /* The unit has already been initialized by another instance */
+#if CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
+        /* Each instance keeps its own pair of GPIOTE channels. */
+        nrfx_err = gpiote_pins_init(p_unit, p_cfg->trig_pin, p_cfg->echo_pin);
+        if (NRFX_SUCCESS != nrfx_err) {
+            goto ERR_EXIT;
+        }
+        p_unit->wired_dev = dev;
+#endif
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+        scheduler_register(dev);
+#endif
+        return 0;
+    }
+
+    err = k_sem_init(&p_unit->fetch_sem, 0, 1);
+    if (0 != err) {
+        return err;
+    }
+    err = k_sem_init(&p_unit->lock_sem, 1, 1);
+    if (0 != err) {
+        return err;
+    }
+
+    nrfx_err = gpiote_in_init(p_cfg->echo_pin);
+    if (NRFX_SUCCESS != nrfx_err) {
+        goto ERR_EXIT;
+    }
+    nrfx_err = gpiote_out_init(p_cfg->trig_pin);
+    if (NRFX_SUCCESS != nrfx_err) {
+        goto ERR_EXIT;
+    }
+    nrfx_err = timer_init(p_unit);
+    if (NRFX_SUCCESS != nrfx_err) {
+        goto ERR_EXIT;
+    }
+    nrfx_err = egu_init(p_unit);
+    if (NRFX_SUCCESS != nrfx_err) {
+        goto ERR_EXIT;
+    }
+    nrfx_err = ppi_init(p_unit, p_cfg->echo_pin, p_cfg->trig_pin);
+    if (NRFX_SUCCESS != nrfx_err) {
+        goto ERR_EXIT;
+    }
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    /* The pins stay configured and the TIMER keeps running from now on. */
+    gpiote_in_event_enable(p_cfg->echo_pin);
+    gpiote_out_task_enable(p_cfg->trig_pin);
+    p_unit->active_dev = dev;
+#if CONFIG_HC_SR04_NRFX_FILTER
+    p_unit->filter.len   = CONFIG_HC_SR04_NRFX_FILTER_MEDIAN_SIZE;
+    p_unit->filter.alpha = ((CONFIG_HC_SR04_NRFX_FILTER_EMA_ALPHA_PERCENT * EMA_ONE) / 100);
+#endif
+    continuous_start(p_unit);
+#elif CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
+    /* The pins stay configured, a fetch only has to start the TIMER. */
+    gpiote_in_event_enable(p_cfg->echo_pin);
+    gpiote_out_task_enable(p_cfg->trig_pin);
+    p_unit->wired_dev = dev;
+#else
+    /* These will be re-initialized for every fetch. */
+    gpiote_in_uninit(p_cfg->echo_pin);
+    gpiote_out_uninit(p_cfg->trig_pin);
+#endif
+
+    p_unit->ready = true;
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+    scheduler_register(dev);
+#endif
+    return 0;
+
+ERR_EXIT:
+    LOG_ERR("%s: init failed: %d", dev->name, nrfx_err);
+    return -ENXIO;
+}
+
+#if CONFIG_HC_SR04_NRFX_VELOCITY
+/* Adds the fetched sample to the history unless it is invalid. */
+static void velocity_update(struct hc_sr04_nrfx_data *p_data)
+{
+    if ((0 == p_data->sensor_value.val1) && (0 == p_data->sensor_value.val2)) {
+        return;
+    }
+    history_add(&p_data->history,
+                p_data->timestamps.trigger,
+                ((p_data->sensor_value.val1 * 1000000) + p_data->sensor_value.val2));
+}
+#endif
+
+static int unit_lock(struct hc_sr04_nrfx_unit *p_unit, struct hc_sr04_nrfx_data *p_data)
+{
+#if CONFIG_HC_SR04_NRFX_STATS
+    int      err;
+    uint32_t start = k_cycle_get_32();
+    uint32_t wait_us;
+
+    err     = k_sem_take(&p_unit->lock_sem, K_FOREVER);
+    wait_us = k_cyc_to_us_near32(k_cycle_get_32() - start);
+    STATS_INCN(p_data->stats, lock_wait_us, wait_us);
+    if (p_data->stats.lock_wait_max_us < wait_us) {
+        p_data->stats.lock_wait_max_us = wait_us;
+    }
+    return err;
+#else
+    ARG_UNUSED(p_data);
+    return k_sem_take(&p_unit->lock_sem, K_FOREVER);
+#endif
+}
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+static int continuous_fetch(const struct hc_sr04_nrfx_cfg *p_cfg,
+                            struct hc_sr04_nrfx_unit *p_unit,
+                            struct hc_sr04_nrfx_data *p_data)
+{
+    uint32_t     count;
+    uint32_t     age;
+    uint32_t     cycles;
+    uint32_t     age_us;
+    bool         has_sample;
+    unsigned int key;
+
+    struct hc_sr04_nrfx_timestamps ts;
+
+    key        = irq_lock();
+    count      = p_unit->latest_count;
+    age        = (k_uptime_get_32() - p_unit->latest_time);
+    cycles     = p_unit->latest_cycles;
+    age_us     = p_unit->latest_age_us;
+    ts         = p_unit->latest_ts;
+    has_sample = p_unit->has_sample;
+#if CONFIG_HC_SR04_NRFX_FILTER
+    if (0 < p_unit->filter.count) {
+        count = filter_output_get(&p_unit->filter);
+    }
+#endif
+    irq_unlock(key);
+
+    if (age > (CONFIG_HC_SR04_NRFX_CONTINUOUS_PERIOD_MS + T_MAX_WAIT_MS)) {
+        /* The sensor missed a TRIG or the EGU interrupt was serviced too late. */
+        DATA_STATS_INC(p_data, timeouts);
+        continuous_start(p_unit);
+        return -EIO;
+    }
+    if (!has_sample) {
+        return -EIO;
+    }
+    DATA_STATS_SET(p_data, last_echo_us, count);
+    ts.trigger         = (cycles - k_us_to_cyc_near32(age_us));
+    p_data->timestamps = ts;
+    if (count_is_valid(count) && (p_data->max_width < count)) {
+        p_data->sensor_value.val1 = 0;
+        p_data->sensor_value.val2 = 0;
+        DATA_STATS_INC(p_data, out_of_range);
+        return -ERANGE;
+    }
+    if (count_to_sensor_value(p_data->scale, count, &p_data->sensor_value)) {
+        if (!echo_is_plausible(p_cfg, &p_data->sensor_value)) {
+            p_data->sensor_value.val1 = 0;
+            p_data->sensor_value.val2 = 0;
+            DATA_STATS_INC(p_data, rejected);
+            return -ERANGE;
+        }
+        DATA_STATS_INC(p_data, valid);
+    } else {
+        DATA_STATS_INC(p_data, invalid);
+    }
+    return 0;
+}
+#endif
+
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS
+/* Waits until the module answers TRIG again, see hc_sr04_nrfx_data.ready_at. */
+static int ready_wait(const struct device *dev, bool async)
+{
+    const struct hc_sr04_nrfx_data *p_data = dev->data;
+    int64_t                         wait_ms = (p_data->ready_at - k_uptime_get());
+
+    if (0 < wait_ms) {
+        if (async) {
+            return -EBUSY;
+        }
+        k_msleep((int32_t)wait_ms);
+    }
+    return 0;
+}
+
+/* Called after an invalid echo instead of sleeping, possibly on the work queue. */
+static void settle_start(struct hc_sr04_nrfx_data *p_data)
+{
+    p_data->settle_time = (k_cycle_get_32() + k_us_to_cyc_ceil32(T_RETRIGGER_HOLDOFF_US));
+    p_data->settling    = true;
+}
+
+/*
+ * Waits for the spurious pulse after an invalid echo to pass before the next
+ * TRIG. A wait longer than the holdoff means the cycle counter has wrapped
+ * since and there is nothing left to wait for.
+ */
+static void settle_wait(struct hc_sr04_nrfx_data *p_data)
+{
+    int32_t wait;
+
+    if (!p_data->settling) {
+        return;
+    }
+    p_data->settling = false;
+    wait = (int32_t)(p_data->settle_time - k_cycle_get_32());
+    if ((0 < wait) && ((int32_t)k_us_to_cyc_ceil32(T_RETRIGGER_HOLDOFF_US) >= wait)) {
+        k_busy_wait(k_cyc_to_us_ceil32(wait));
+    }
+}
+
+static int oneshot_start(const struct device *dev, bool async)
+{
+    int          err;
+    nrfx_err_t   nrfx_err;
+    unsigned int key;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    int32_t                   busy_ms = (int32_t)(p_unit->busy_until - k_uptime_get_32());
+    struct hc_sr04_nrfx_data *p_data  = dev->data;
+
+    if (0 < busy_ms) {
+        /* The previous sensor is still sending its aborted invalid pulse. */
+        if (async) {
+            return -EBUSY;
+        }
+        k_msleep(busy_ms);
+    }
+    p_unit->out_of_range = false;
+    nrfx_timer_compare(&p_unit->timer, TIMER_ECHO_START_CHAN, 0, false);
+    /* HC_SR04_NRFX_ATTR_MAX_RANGE can only bring the timeout closer. */
+    p_unit->timeout_span = (MIN(TIMER_TIMEOUT_COUNT,
+                                (TIMER_TRIG_DOWN_COUNT + T_ECHO_DELAY_US + p_data->max_width)) -
+                            TIMER_TRIG_UP_COUNT);
+    timeout_schedule(p_unit, TIMER_TRIG_UP_COUNT);
+#endif
+
+    err = ready_wait(dev, async);
+    if (0 != err) {
+        return err;
+    }
+    settle_wait(dev->data);
+
+#if CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
+    ARG_UNUSED(nrfx_err);
+    if (p_unit->wired_dev != dev) {
+        ppi_endpoints_setup(p_unit, p_cfg->trig_pin, p_cfg->echo_pin);
+        p_unit->wired_dev = dev;
+    }
+#else
+    nrfx_err = gpiote_pins_init(p_unit, p_cfg->trig_pin, p_cfg->echo_pin);
+    if (NRFX_SUCCESS != nrfx_err) {
+        DATA_STATS_INC(dev->data, gpiote_errors);
+        return -ENXIO;
+    }
+#endif
+
+    k_sem_reset(&p_unit->fetch_sem);
+    p_unit->active_dev = dev;
+    p_unit->async      = async;
+    /* A timed out measurement leaves the TIMER somewhere past the TRIG compares. */
+    nrfx_timer_clear(&p_unit->timer);
+    key = irq_lock();
+    nrfx_timer_enable(&p_unit->timer);
+    p_unit->trigger_cycles = k_cycle_get_32();
+    irq_unlock(key);
+    return 0;
+}
+
+static void oneshot_stop(const struct device *dev)
+{
+    const struct hc_sr04_nrfx_cfg *p_cfg = dev->config;
+
+    nrfx_timer_disable(&p_cfg->p_unit->timer);
+#if CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
+    ARG_UNUSED(p_cfg);
+#else
+    gpiote_pins_uninit(p_cfg->trig_pin, p_cfg->echo_pin);
+#endif
+}
+
+static void oneshot_timestamps_get(struct hc_sr04_nrfx_unit *p_unit,
+                                   struct hc_sr04_nrfx_timestamps *p_ts)
+{
+    /* TRIG goes high TIMER_TRIG_UP_COUNT microseconds after the TIMER was started. */
+    p_ts->trigger    = p_unit->trigger_cycles;
+    p_ts->echo_start = (nrfx_timer_capture_get(&p_unit->timer, TIMER_ECHO_START_CHAN) -
+                        TIMER_TRIG_UP_COUNT);
+    p_ts->echo_end   = (nrfx_timer_capture_get(&p_unit->timer, TIMER_ECHO_END_CHAN) -
+                        TIMER_TRIG_UP_COUNT);
+}
+
+static int oneshot_finish(const struct device *dev,
+                          bool completed,
+                          struct sensor_value *p_value,
+                          struct hc_sr04_nrfx_timestamps *p_ts)
+{
+    uint32_t count;
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+    struct hc_sr04_nrfx_sample sample;
+#endif
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_data      *p_data = dev->data;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    oneshot_stop(dev);
+
+    if (!completed) {
+        DATA_STATS_INC(p_data, timeouts);
+        return -EIO;
+    }
+
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    if (p_unit->out_of_range) {
+        p_unit->busy_until = (k_uptime_get_32() +
+                              ceiling_fraction(sensor_ready_delay_get(p_unit), 1000));
+        p_value->val1 = 0;
+        p_value->val2 = 0;
+        DATA_STATS_INC(p_data, out_of_range);
+        return -ERANGE;
+    }
+#endif
+
+    count = capture_width_get(p_unit);
+    oneshot_timestamps_get(p_unit, p_ts);
+    DATA_STATS_SET(p_data, last_echo_us, count);
+    if (count_is_valid(count) && (p_data->max_width < count)) {
+        p_value->val1 = 0;
+        p_value->val2 = 0;
+        DATA_STATS_INC(p_data, out_of_range);
+        return -ERANGE;
+    }
+    if (count_to_sensor_value(p_data->scale, count, p_value)) {
+        if (!echo_is_plausible(p_cfg, p_value)) {
+            p_value->val1 = 0;
+            p_value->val2 = 0;
+            DATA_STATS_INC(p_data, rejected);
+            return -ERANGE;
+        }
+        DATA_STATS_INC(p_data, valid);
+    } else {
+        DATA_STATS_INC(p_data, invalid);
+        settle_start(p_data);
+    }
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+    sample.trigger = p_ts->trigger;
+    sample.width   = count;
+    listeners_notify(dev, &sample);
+#endif
+    return 0;
+}
+
+static int oneshot_fetch(const struct device *dev,
+                         struct sensor_value *p_value,
+                         struct hc_sr04_nrfx_timestamps *p_ts)
+{
+    int  err;
+    bool completed;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg = dev->config;
+
+    err = oneshot_start(dev, false);
+    if (0 != err) {
+        return err;
+    }
+    completed = (0 == k_sem_take(&p_cfg->p_unit->fetch_sem, K_MSEC(T_MAX_WAIT_MS)));
+    return oneshot_finish(dev, completed, p_value, p_ts);
+}
+#endif
+
+int hc_sr04_nrfx_read_burst(const struct device *dev, uint32_t *widths, size_t n)
+{
+    int          err;
+    bool         completed;
+    size_t       collected;
+    unsigned int key;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    if (unlikely(!p_unit->ready)) {
+        LOG_ERR("Driver is not initialized yet");
+        return -EBUSY;
+    }
+    if ((NULL == widths) || (0 == n)) {
+        return -EINVAL;
+    }
+    if (DATA_SUSPENDED((struct hc_sr04_nrfx_data *)dev->data)) {
+        return -EIO;
+    }
+
+    err = unit_lock(p_unit, dev->data);
+    if (0 != err) {
+        return err;
+    }
+
+    key = irq_lock();
+    p_unit->p_burst   = widths;
+    p_unit->burst_idx = 0;
+    p_unit->burst_len = n;
+    irq_unlock(key);
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    k_sem_reset(&p_unit->fetch_sem);
+    completed = (0 == k_sem_take(&p_unit->fetch_sem,
+                                 K_MSEC(n * (CONFIG_HC_SR04_NRFX_CONTINUOUS_PERIOD_MS +
+                                             T_MAX_WAIT_MS))));
+#else
+    err = oneshot_start(dev, false);
+    if (0 != err) {
+        p_unit->burst_len = 0;
+        k_sem_give(&p_unit->lock_sem);
+        return err;
+    }
+    completed = (0 == k_sem_take(&p_unit->fetch_sem,
+                                 K_MSEC(n * (T_MAX_WAIT_MS + (TIMER_BURST_UP_COUNT / 1000) + 1))));
+#endif
+
+    key = irq_lock();
+    collected = p_unit->burst_idx;
+    p_unit->burst_len = 0;
+    irq_unlock(key);
+
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS
+    oneshot_stop(dev);
+    trigger_schedule(p_unit, TIMER_TRIG_UP_COUNT);
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+    if (p_unit->out_of_range) {
+        p_unit->busy_until = (k_uptime_get_32() +
+                              ceiling_fraction(sensor_ready_delay_get(p_unit), 1000));
+    }
+#endif
+    if ((0 < collected) && (T_INVALID_PULSE_US <= widths[collected - 1])) {
+        settle_start(dev->data);
+    }
+#endif
+
+    k_sem_give(&p_unit->lock_sem);
+
+    if (!completed) {
+        LOG_DBG("Burst stopped after %u of %u measurements",
+                (unsigned int)collected, (unsigned int)n);
+        if (0 == collected) {
+            return -EIO;
+        }
+    }
+    return collected;
+}
+
+#if CONFIG_HC_SR04_NRFX_TRIGGER
+static void trigger_work_handler(struct k_work *work)
+{
+    struct hc_sr04_nrfx_data *p_data = CONTAINER_OF(work, struct hc_sr04_nrfx_data, work.work);
+    sensor_trigger_handler_t  handler;
+
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS
+    int          err;
+    bool         completed;
+    bool         pending;
+    unsigned int key;
+#if CONFIG_HC_SR04_NRFX_FETCH_ASYNC
+    struct k_poll_signal *p_signal;
+#endif
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = p_data->dev->config;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    /*
+     * Submitted by egu_handler() on completion or by the timeout. With
+     * persistent pins a late echo edge or the spurious pulse still reaches
+     * the EGU after the measurement was finished, so only the first run
+     * finishes it.
+     */
+    key = irq_lock();
+    pending       = p_unit->async;
+    p_unit->async = false;
+    irq_unlock(key);
+    if (!pending) {
+        return;
+    }
+
+    completed = (0 == k_sem_take(&p_unit->fetch_sem, K_NO_WAIT));
+    err = oneshot_finish(p_data->dev, completed, &p_data->sensor_value, &p_data->timestamps);
+#if CONFIG_HC_SR04_NRFX_VELOCITY
+    if (0 == err) {
+        velocity_update(p_data);
+    }
+#endif
+#if CONFIG_HC_SR04_NRFX_FETCH_ASYNC
+    p_signal         = p_data->p_signal;
+    p_data->p_signal = NULL;
+#endif
+    k_sem_give(&p_unit->lock_sem);
+#if CONFIG_HC_SR04_NRFX_FETCH_ASYNC
+    if (NULL != p_signal) {
+        (void) k_poll_signal_raise(p_signal, err);
+    }
+#endif
+    if (0 != err) {
+        return;
+    }
+#endif
+
+    handler = p_data->data_ready_handler;
+    if (NULL != handler) {
+        p_data->data_ready_thread = k_current_get();
+        handler(p_data->dev, &p_data->data_ready_trigger);
+        p_data->data_ready_thread = NULL;
+    }
+}
+
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS && !CONFIG_HC_SR04_NRFX_SCHEDULER
+/* Must be called with the unit's lock_sem held. */
+static int async_start(const struct device *dev)
+{
+    int err;
+
+    struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    err = oneshot_start(dev, true);
+    if (0 != err) {
+        return err;
+    }
+    /* The EGU interrupt reschedules this immediately on completion. */
+    (void) k_delayed_work_submit(&p_data->work, K_MSEC(T_MAX_WAIT_MS));
+    return 0;
+}
+
+static int async_fetch(const struct device *dev)
+{
+    int err;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    if (0 != k_sem_take(&p_unit->lock_sem, K_NO_WAIT)) {
+        return -EBUSY;
+    }
+    err = async_start(dev);
+    if (0 != err) {
+        k_sem_give(&p_unit->lock_sem);
+    }
+    return err;
+}
+#endif
+
+static int hc_sr04_nrfx_trigger_set(const struct device *dev,
+                    const struct sensor_trigger *trig,
+                    sensor_trigger_handler_t handler)
+{
+    struct hc_sr04_nrfx_data *p_data = dev->data;
+    unsigned int              key;
+
+    if (SENSOR_TRIG_DATA_READY != trig->type) {
+        return -ENOTSUP;
+    }
+    if ((SENSOR_CHAN_ALL != trig->chan) && (SENSOR_CHAN_DISTANCE != trig->chan)) {
+        return -ENOTSUP;
+    }
+
+    key = irq_lock();
+    p_data->data_ready_trigger = *trig;
+    p_data->data_ready_handler = handler;
+    irq_unlock(key);
+    return 0;
+}
+#endif
+
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+static void scheduler_publish(const struct device *dev,
+                              int err,
+                              const struct sensor_value *p_value,
+                              const struct hc_sr04_nrfx_timestamps *p_ts)
+{
+    unsigned int key;
+
+    struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    key = irq_lock();
+    p_data->scheduled_err = err;
+    if (0 == err) {
+        p_data->scheduled_value      = *p_value;
+        p_data->scheduled_timestamps = *p_ts;
+    }
+    irq_unlock(key);
 
-    nrfx_err = nrfx_gpiote_in_init(p_cfg->echo_pin, &m_shared_resources.echo_in, gpiote_handler);
-    if (NRFX_SUCCESS != nrfx_err) {
-        goto ERR_EXIT;
+#if CONFIG_HC_SR04_NRFX_TRIGGER
+    if ((0 == err) && (NULL != p_data->data_ready_handler)) {
+        p_data->data_ready_handler(dev, &p_data->data_ready_trigger);
     }
-    nrfx_err = nrfx_gpiote_out_init(p_cfg->trig_pin, &m_shared_resources.trig_out);
-    if (NRFX_SUCCESS != nrfx_err) {
-        goto ERR_EXIT;
+#endif
+}
+
+/*
+ * Returns the number of devices from first on that are fired together. With
+ * CONFIG_HC_SR04_NRFX_SCHEDULER_GROUPS these are the following devices with
+ * the same scan-order, up to the first one that shares a unit with another.
+ */
+static size_t scheduler_slot_get(size_t first)
+{
+    size_t i;
+    size_t j;
+
+    const struct device **p_devs = m_shared_resources.sched_devs;
+
+    for (i = (first + 1); i < m_shared_resources.sched_count; i++) {
+        if (!IS_ENABLED(CONFIG_HC_SR04_NRFX_SCHEDULER_GROUPS) ||
+            (scan_order_get(p_devs[i]) != scan_order_get(p_devs[first]))) {
+            break;
+        }
+        for (j = first; j < i; j++) {
+            if (((const struct hc_sr04_nrfx_cfg *)p_devs[i]->config)->p_unit ==
+                ((const struct hc_sr04_nrfx_cfg *)p_devs[j]->config)->p_unit) {
+                return (i - first);
+            }
+        }
     }
-    nrfx_err = timer_init();
-    if (NRFX_SUCCESS != nrfx_err) {
-        goto ERR_EXIT;
+    return (i - first);
+}
+
+/* Triggers all devices at once, each of them on its own unit. */
+static void scheduler_measure(const struct device **p_devs, size_t count)
+{
+    int                 err[INSTANCE_COUNT];
+    bool                completed;
+    int64_t             remaining;
+    int64_t             deadline;
+    size_t              i;
+    struct sensor_value value;
+
+    struct hc_sr04_nrfx_timestamps ts;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg;
+    struct hc_sr04_nrfx_data      *p_data;
+
+    for (i = 0; i < count; i++) {
+        p_cfg  = p_devs[i]->config;
+        p_data = p_devs[i]->data;
+        (void) unit_lock(p_cfg->p_unit, p_data);
+        if (DATA_SUSPENDED(p_data)) {
+            err[i] = -EIO;
+        } else {
+            err[i] = oneshot_start(p_devs[i], false);
+        }
     }
-    nrfx_err = egu_init(&p_egu);
-    if (NRFX_SUCCESS != nrfx_err) {
-        goto ERR_EXIT;
+
+    deadline = (k_uptime_get() + T_MAX_WAIT_MS);
+    for (i = 0; i < count; i++) {
+        p_cfg = p_devs[i]->config;
+        if (0 == err[i]) {
+            remaining = MAX((deadline - k_uptime_get()), 0);
+            completed = (0 == k_sem_take(&p_cfg->p_unit->fetch_sem, K_MSEC(remaining)));
+            err[i]    = oneshot_finish(p_devs[i], completed, &value, &ts);
+        }
+        k_sem_give(&p_cfg->p_unit->lock_sem);
+        scheduler_publish(p_devs[i], err[i], &value, &ts);
     }
-    nrfx_err = ppi_init(p_egu, p_cfg->echo_pin, p_cfg->trig_pin);
-    if (NRFX_SUCCESS != nrfx_err) {
-        goto ERR_EXIT;
+}
+
+static void scheduler_thread(void *p1, void *p2, void *p3)
+{
+    int64_t sweep_start;
+    int64_t elapsed;
+    size_t  slot;
+    size_t  i;
+
+    if (0 == m_shared_resources.sched_count) {
+        LOG_ERR("No device initialized, scheduler not started");
+        return;
     }
 
-    /* These will be re-initialized for every fetch. */
-    nrfx_gpiote_in_uninit(p_cfg->echo_pin);
-    nrfx_gpiote_out_uninit(p_cfg->trig_pin);
+    for (;;) {
+        sweep_start = k_uptime_get();
+        for (i = 0; i < m_shared_resources.sched_count; i += slot) {
+            slot = scheduler_slot_get(i);
+            scheduler_measure(&m_shared_resources.sched_devs[i], slot);
+            /* Let the previous pings decay before the next sensors fire. */
+            k_msleep(CONFIG_HC_SR04_NRFX_SCHEDULER_GUARD_MS);
+        }
+        elapsed = (k_uptime_get() - sweep_start);
+        if (CONFIG_HC_SR04_NRFX_SCHEDULER_PERIOD_MS > elapsed) {
+            k_msleep(CONFIG_HC_SR04_NRFX_SCHEDULER_PERIOD_MS - (int32_t)elapsed);
+        }
+    }
+}
 
-    m_shared_resources.ready = true;
-    return 0;
+K_THREAD_DEFINE(hc_sr04_nrfx_scheduler,
+                CONFIG_HC_SR04_NRFX_SCHEDULER_STACK_SIZE,
+                scheduler_thread, NULL, NULL, NULL,
+                CONFIG_HC_SR04_NRFX_SCHEDULER_PRIORITY, 0, 0);
 
-ERR_EXIT:
-    return -ENXIO;
+static int scheduled_fetch(struct hc_sr04_nrfx_data *p_data)
+{
+    int          err;
+    unsigned int key;
+
+    key = irq_lock();
+    err = p_data->scheduled_err;
+    if (0 == err) {
+        p_data->sensor_value = p_data->scheduled_value;
+        p_data->timestamps   = p_data->scheduled_timestamps;
+    }
+    irq_unlock(key);
+    return err;
 }
+#endif
 
 static int hc_sr04_nrfx_sample_fetch(const struct device *dev, enum sensor_channel chan)
 {
-    int        err;
-    nrfx_err_t nrfx_err;
-    uint32_t   count;
+    int err;
 
     const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
     struct hc_sr04_nrfx_data      *p_data = dev->data;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
 
     if (unlikely((SENSOR_CHAN_ALL != chan) && (SENSOR_CHAN_DISTANCE != chan))) {
         return -ENOTSUP;
     }
 
-    if (unlikely(!m_shared_resources.ready)) {
+    if (unlikely(!p_unit->ready)) {
         LOG_ERR("Driver is not initialized yet");
         return -EBUSY;
     }
+    if (DATA_SUSPENDED(p_data)) {
+        return -EIO;
+    }
+
+#if CONFIG_HC_SR04_NRFX_TRIGGER && !CONFIG_HC_SR04_NRFX_CONTINUOUS && \
+    !CONFIG_HC_SR04_NRFX_SCHEDULER
+    if (k_current_get() == p_data->data_ready_thread) {
+        /* The handler's measurement is already in sensor_value; don't start another. */
+        return 0;
+    }
+#endif
+
+    DATA_STATS_INC(p_data, fetches);
+
+#if CONFIG_HC_SR04_NRFX_SCHEDULER
+    /* The scheduler owns the sensors; return its latest reading. */
+    err = scheduled_fetch(p_data);
+#else
+#if CONFIG_HC_SR04_NRFX_TRIGGER && !CONFIG_HC_SR04_NRFX_CONTINUOUS
+    if (NULL != p_data->data_ready_handler) {
+        /* Completion is reported through the DATA_READY handler. */
+        return async_fetch(dev);
+    }
+#endif
 
-    err = k_mutex_lock(&m_shared_resources.mutex, K_FOREVER);
+    err = unit_lock(p_unit, p_data);
     if (0 != err) {
         return err;
     }
 
-    nrfx_err = gpiote_pins_init(p_cfg->trig_pin, p_cfg->echo_pin);
-    if (NRFX_SUCCESS != nrfx_err) {
-        LOG_ERR("GPIOTE init failed: %d", nrfx_err);
-        (void) k_mutex_unlock(&m_shared_resources.mutex);
-        return -ENXIO;
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    err = continuous_fetch(p_cfg, p_unit, p_data);
+#else
+    err = oneshot_fetch(dev, &p_data->sensor_value, &p_data->timestamps);
+#endif
+
+    k_sem_give(&p_unit->lock_sem);
+#endif
+#if CONFIG_HC_SR04_NRFX_VELOCITY
+    if (0 == err) {
+        velocity_update(p_data);
+    }
+#endif
+    return err;
+}
+
+static int hc_sr04_nrfx_channel_get(const struct device *dev,
+                    enum sensor_channel chan,
+                    struct sensor_value *val)
+{
+    const struct hc_sr04_nrfx_cfg  *p_cfg  = dev->config;
+    const struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    if (unlikely(!p_cfg->p_unit->ready)) {
+        LOG_WRN("Device is not initialized yet");
+        return -EBUSY;
+    }
+
+    switch ((int)chan) {
+    case SENSOR_CHAN_DISTANCE:
+        val->val2 = p_data->sensor_value.val2;
+        val->val1 = p_data->sensor_value.val1;
+        break;
+#if CONFIG_HC_SR04_NRFX_VELOCITY
+    case HC_SR04_NRFX_CHAN_VELOCITY:
+        return history_velocity_get(&p_data->history, val);
+#endif
+    default:
+        return -ENOTSUP;
     }
+    return 0;
+}
+
+#if CONFIG_HC_SR04_NRFX_FETCH_ASYNC
+int hc_sr04_nrfx_fetch_async(const struct device *dev, struct k_poll_signal *signal)
+{
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+#if !CONFIG_HC_SR04_NRFX_CONTINUOUS && !CONFIG_HC_SR04_NRFX_SCHEDULER
+    int                            err;
+    struct hc_sr04_nrfx_data      *p_data = dev->data;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+#endif
 
-    nrfx_timer_enable(&m_shared_resources.timer);
+    if (unlikely(!p_cfg->p_unit->ready)) {
+        LOG_ERR("Driver is not initialized yet");
+        return -EBUSY;
+    }
+    if (NULL == signal) {
+        return -EINVAL;
+    }
 
-    if (0 != k_sem_take(&m_shared_resources.fetch_sem, K_MSEC(T_MAX_WAIT_MS))) {
-        LOG_DBG("No response from HC-SR04.");
-        nrfx_timer_disable(&m_shared_resources.timer);
-        gpiote_pins_uninit(p_cfg->trig_pin, p_cfg->echo_pin);
-        (void) k_mutex_unlock(&m_shared_resources.mutex);
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS || CONFIG_HC_SR04_NRFX_SCHEDULER
+    /* sample_fetch returns the latest reading without waiting for the sensor. */
+    (void) k_poll_signal_raise(signal, hc_sr04_nrfx_sample_fetch(dev, SENSOR_CHAN_ALL));
+    return 0;
+#else
+    if (DATA_SUSPENDED(p_data)) {
         return -EIO;
     }
 
-    nrfx_timer_disable(&m_shared_resources.timer);
-    gpiote_pins_uninit(p_cfg->trig_pin, p_cfg->echo_pin);
+    DATA_STATS_INC(p_data, fetches);
+
+    if (0 != k_sem_take(&p_unit->lock_sem, K_NO_WAIT)) {
+        return -EBUSY;
+    }
+    p_data->p_signal = signal;
+    err = async_start(dev);
+    if (0 != err) {
+        p_data->p_signal = NULL;
+        k_sem_give(&p_unit->lock_sem);
+    }
+    return err;
+#endif
+}
+#endif
 
-    count  = nrfx_timer_capture_get(&m_shared_resources.timer, TIMER_ECHO_END_CHAN);
-    count -= nrfx_timer_capture_get(&m_shared_resources.timer, TIMER_ECHO_START_CHAN);
-    if ((T_INVALID_PULSE_US > count) && (T_TRIG_PULSE_US < count)) {
-        /* Convert to meters and divide round-trip distance by two */
-        count = (count * METERS_PER_SEC / 2);
-        p_data->sensor_value.val2 = (count % 1000000);
-        p_data->sensor_value.val1 = (count / 1000000);
+#if CONFIG_HC_SR04_NRFX_STREAM
+int hc_sr04_nrfx_stream_start(const struct device *dev, struct ring_buf *buf)
+{
+    unsigned int key;
+    int          err = 0;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    if (unlikely(!p_unit->ready)) {
+        LOG_ERR("Driver is not initialized yet");
+        return -EBUSY;
+    }
+    if (NULL == buf) {
+        return -EINVAL;
+    }
+
+    key = irq_lock();
+    if (NULL != p_unit->p_stream) {
+        err = -EALREADY;
     } else {
-        LOG_INF("Invalid measurement");
-        p_data->sensor_value.val1 = 0;
-        p_data->sensor_value.val2 = 0;
-        k_usleep(T_SPURIOS_WAIT_US);
+        p_unit->p_stream       = buf;
+        p_unit->stream_dropped = 0;
     }
+    irq_unlock(key);
+    return err;
+}
 
-    err = k_mutex_unlock(&m_shared_resources.mutex);
-    if (0 != err) {
-        return err;
+int hc_sr04_nrfx_stream_stop(const struct device *dev)
+{
+    unsigned int key;
+    uint32_t     dropped;
+
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    key = irq_lock();
+    p_unit->p_stream = NULL;
+    dropped          = p_unit->stream_dropped;
+    irq_unlock(key);
+    return MIN(dropped, INT32_MAX);
+}
+#endif
+
+#if CONFIG_HC_SR04_NRFX_LISTENERS
+int hc_sr04_nrfx_listener_add(const struct device *dev, struct hc_sr04_nrfx_listener *listener)
+{
+    unsigned int key;
+
+    struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    if ((NULL == listener) || (NULL == listener->handler)) {
+        return -EINVAL;
     }
+
+    /* The EGU interrupt walks the list in continuous mode. */
+    key = irq_lock();
+    sys_slist_append(&p_data->listeners, &listener->node);
+    irq_unlock(key);
     return 0;
 }
 
-static int hc_sr04_nrfx_channel_get(const struct device *dev,
-                    enum sensor_channel chan,
-                    struct sensor_value *val)
+int hc_sr04_nrfx_listener_remove(const struct device *dev, struct hc_sr04_nrfx_listener *listener)
+{
+    unsigned int key;
+    bool         found;
+
+    struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    key   = irq_lock();
+    found = sys_slist_find_and_remove(&p_data->listeners, &listener->node);
+    irq_unlock(key);
+    return (found ? 0 : -ENOENT);
+}
+#endif
+
+#if CONFIG_HC_SR04_NRFX_STREAM || CONFIG_HC_SR04_NRFX_LISTENERS
+int hc_sr04_nrfx_sample_decode(const struct device *dev,
+                               const struct hc_sr04_nrfx_sample *sample,
+                               struct sensor_value *val)
+{
+    const struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    return (count_to_sensor_value(p_data->scale, sample->width, val) ? 0 : -ERANGE);
+}
+#endif
+
+int hc_sr04_nrfx_timestamps_get(const struct device *dev, struct hc_sr04_nrfx_timestamps *p_ts)
 {
+    const struct hc_sr04_nrfx_cfg  *p_cfg  = dev->config;
     const struct hc_sr04_nrfx_data *p_data = dev->data;
 
-    if (unlikely(!m_shared_resources.ready)) {
+    if (unlikely(!p_cfg->p_unit->ready)) {
         LOG_WRN("Device is not initialized yet");
         return -EBUSY;
     }
 
-    switch (chan) {
-    case SENSOR_CHAN_DISTANCE:
-        val->val2 = p_data->sensor_value.val2;
-        val->val1 = p_data->sensor_value.val1;
+    *p_ts = p_data->timestamps;
+    return 0;
+}
+
+static int hc_sr04_nrfx_attr_set(const struct device *dev,
+                    enum sensor_channel chan,
+                    enum sensor_attribute attr,
+                    const struct sensor_value *val)
+{
+    struct hc_sr04_nrfx_data *p_data = dev->data;
+    int64_t                   milli;
+    int64_t                   um;
+#if CONFIG_HC_SR04_NRFX_FILTER
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+    unsigned int                   key;
+#endif
+
+    if ((SENSOR_CHAN_ALL != chan) && (SENSOR_CHAN_DISTANCE != chan)) {
+        return -ENOTSUP;
+    }
+
+    milli = (((int64_t)val->val1 * 1000) + (val->val2 / 1000));
+
+    switch ((int)attr) {
+    case HC_SR04_NRFX_ATTR_AMBIENT_TEMP:
+        if ((AMBIENT_MC_MIN > milli) || (AMBIENT_MC_MAX < milli)) {
+            return -EINVAL;
+        }
+        p_data->scale = SPEED_TO_SCALE(SOUND_MM_PER_SEC_0C +
+                                       (milli * SOUND_MM_PER_SEC_PER_C / 1000));
+        break;
+    case HC_SR04_NRFX_ATTR_SPEED_OF_SOUND:
+        if ((SOUND_MM_PER_SEC_MIN > milli) || (SOUND_MM_PER_SEC_MAX < milli)) {
+            return -EINVAL;
+        }
+        p_data->scale = SPEED_TO_SCALE(milli);
         break;
+    case HC_SR04_NRFX_ATTR_MAX_RANGE:
+        um = (((int64_t)val->val1 * 1000000) + val->val2);
+        if ((0 != um) && ((MAX_RANGE_UM_MIN > um) || (MAX_RANGE_UM_MAX < um))) {
+            return -EINVAL;
+        }
+        p_data->max_range_um = um;
+        break;
+#if CONFIG_HC_SR04_NRFX_FILTER
+    case HC_SR04_NRFX_ATTR_MEDIAN_WINDOW:
+        if ((1 > val->val1) || (CONFIG_HC_SR04_NRFX_FILTER_MEDIAN_SIZE < val->val1)) {
+            return -EINVAL;
+        }
+        key = irq_lock();
+        p_unit->filter.len = val->val1;
+        filter_reset(&p_unit->filter);
+        irq_unlock(key);
+        break;
+    case HC_SR04_NRFX_ATTR_EMA_ALPHA:
+        if ((0 >= milli) || (1000 < milli)) {
+            return -EINVAL;
+        }
+        key = irq_lock();
+        p_unit->filter.alpha = ((milli * EMA_ONE) / 1000);
+        irq_unlock(key);
+        break;
+#endif
     default:
         return -ENOTSUP;
     }
+    if ((HC_SR04_NRFX_ATTR_AMBIENT_TEMP == (int)attr) ||
+        (HC_SR04_NRFX_ATTR_SPEED_OF_SOUND == (int)attr) ||
+        (HC_SR04_NRFX_ATTR_MAX_RANGE == (int)attr)) {
+        max_width_update(p_data);
+    }
+#if CONFIG_HC_SR04_NRFX_VELOCITY
+    if ((HC_SR04_NRFX_ATTR_AMBIENT_TEMP == (int)attr) ||
+        (HC_SR04_NRFX_ATTR_SPEED_OF_SOUND == (int)attr)) {
+        /* Distances converted with the old speed of sound would show as movement. */
+        history_reset(&p_data->history);
+    }
+#endif
+    return 0;
+}
+
+int hc_sr04_nrfx_current_estimate(const struct device *dev, uint32_t period_ms, uint32_t *p_ua)
+{
+    uint64_t charge; /* Microamperes times microseconds */
+    uint32_t ranging_us;
+    uint64_t powered_us;
+    uint64_t period_us = ((uint64_t)period_ms * 1000);
+
+    const struct hc_sr04_nrfx_cfg  *p_cfg  = dev->config;
+    const struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    if (0 == p_data->timestamps.echo_end) {
+        return -ENODATA;
+    }
+
+    /* The latest echo stands in for every measurement. */
+    ranging_us = p_data->timestamps.echo_end;
+    powered_us = period_us;
+#if CONFIG_DEVICE_POWER_MANAGEMENT
+    if (POWER_PIN_NONE != p_cfg->power_pin) {
+        /* Assumes the device is suspended between measurements. */
+        powered_us = (((uint64_t)CONFIG_HC_SR04_NRFX_POWER_ON_DELAY_MS * 1000) + ranging_us);
+    }
+#else
+    ARG_UNUSED(p_cfg);
+#endif
+    if (powered_us > period_us) {
+        return -EINVAL;
+    }
+
+    charge = (((uint64_t)CONFIG_HC_SR04_NRFX_IDLE_CURRENT_UA * (powered_us - ranging_us)) +
+              ((uint64_t)CONFIG_HC_SR04_NRFX_ACTIVE_CURRENT_UA * ranging_us));
+    *p_ua = (uint32_t)(charge / period_us);
+    return 0;
+}
+
+#if CONFIG_DEVICE_POWER_MANAGEMENT
+/* Stops everything that keeps the HFCLK running between measurements. */
+static void pm_suspend(const struct device *dev)
+{
+    const struct hc_sr04_nrfx_cfg *p_cfg = dev->config;
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    unsigned int key = irq_lock();
+
+    nrfx_timer_disable(&p_cfg->p_unit->timer);
+    gpiote_in_event_disable(p_cfg->echo_pin);
+    irq_unlock(key);
+#elif CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
+    gpiote_in_event_disable(p_cfg->echo_pin);
+#endif
+    /* Otherwise the TIMER and GPIOTE channels are only used during a fetch. */
+
+    if (POWER_PIN_NONE != p_cfg->power_pin) {
+        nrf_gpio_pin_clear(p_cfg->power_pin);
+    }
+}
+
+static void pm_resume(const struct device *dev)
+{
+    const struct hc_sr04_nrfx_cfg *p_cfg = dev->config;
+
+    if (POWER_PIN_NONE != p_cfg->power_pin) {
+        nrf_gpio_pin_set(p_cfg->power_pin);
+        k_msleep(CONFIG_HC_SR04_NRFX_POWER_ON_DELAY_MS);
+    }
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS
+    gpiote_in_event_enable(p_cfg->echo_pin);
+    continuous_start(p_cfg->p_unit);
+#elif CONFIG_HC_SR04_NRFX_PERSISTENT_PINS
+    gpiote_in_event_enable(p_cfg->echo_pin);
+#endif
+}
+
+static int pm_state_set(const struct device *dev, uint32_t state)
+{
+    const struct hc_sr04_nrfx_cfg *p_cfg  = dev->config;
+    struct hc_sr04_nrfx_data      *p_data = dev->data;
+    struct hc_sr04_nrfx_unit      *p_unit = p_cfg->p_unit;
+
+    if (state == p_data->pm_state) {
+        return 0;
+    }
+    if (unlikely(!p_unit->ready)) {
+        return -EBUSY;
+    }
+    /* Don't wait, the lock may be held until the system work queue runs. */
+    if (0 != k_sem_take(&p_unit->lock_sem, K_NO_WAIT)) {
+        return -EBUSY;
+    }
+
+    if (DEVICE_PM_ACTIVE_STATE == state) {
+        pm_resume(dev);
+    } else if (DEVICE_PM_ACTIVE_STATE == p_data->pm_state) {
+        pm_suspend(dev);
+    }
+    p_data->pm_state = state;
+
+    k_sem_give(&p_unit->lock_sem);
     return 0;
 }
 
+static int hc_sr04_nrfx_pm_control(const struct device *dev,
+                                   uint32_t ctrl_command,
+                                   void *context,
+                                   device_pm_cb cb,
+                                   void *arg)
+{
+    int err = 0;
+
+    struct hc_sr04_nrfx_data *p_data = dev->data;
+
+    switch (ctrl_command) {
+    case DEVICE_PM_SET_POWER_STATE:
+        err = pm_state_set(dev, *((uint32_t *)context));
+        break;
+    case DEVICE_PM_GET_POWER_STATE:
+        *((uint32_t *)context) = p_data->pm_state;
+        break;
+    default:
+        err = -ENOTSUP;
+        break;
+    }
+
+    if (NULL != cb) {
+        cb(dev, err, context, arg);
+    }
+    return err;
+}
+
+#define PM_CONTROL hc_sr04_nrfx_pm_control
+#else
+#define PM_CONTROL device_pm_control_nop
+#endif
+
 static const struct sensor_driver_api hc_sr04_nrfx_driver_api = {
+#if CONFIG_HC_SR04_NRFX_TRIGGER
+    .trigger_set  = hc_sr04_nrfx_trigger_set,
+#endif
+    .attr_set     = hc_sr04_nrfx_attr_set,
     .sample_fetch = hc_sr04_nrfx_sample_fetch,
     .channel_get  = hc_sr04_nrfx_channel_get,
 };
 
-#define INST(num) DT_INST(num, elecfreaks_hc_sr04_nrfx)
+#if CONFIG_HC_SR04_NRFX_STATS && CONFIG_SHELL
+static int stats_print(struct stats_hdr *p_hdr, void *p_arg, const char *p_name, uint16_t off)
+{
+    shell_print((const struct shell *)p_arg, "%s: %u",
+                p_name, *(uint32_t *)((uint8_t *)p_hdr + off));
+    return 0;
+}
+
+static struct hc_sr04_nrfx_data *shell_data_get(const struct shell *shell, const char *name)
+{
+    const struct device *dev = device_get_binding(name);
+
+    if ((NULL == dev) || (&hc_sr04_nrfx_driver_api != dev->api)) {
+        shell_error(shell, "%s is not an HC-SR04_NRFX device", name);
+        return NULL;
+    }
+    return dev->data;
+}
+
+static int cmd_stats(const struct shell *shell, size_t argc, char **argv)
+{
+    struct hc_sr04_nrfx_data *p_data = shell_data_get(shell, argv[1]);
+
+    if (NULL == p_data) {
+        return -ENODEV;
+    }
+    return stats_walk(&p_data->stats.s_hdr, stats_print, (void *)shell);
+}
+
+static int cmd_reset(const struct shell *shell, size_t argc, char **argv)
+{
+    struct hc_sr04_nrfx_data *p_data = shell_data_get(shell, argv[1]);
+
+    if (NULL == p_data) {
+        return -ENODEV;
+    }
+    stats_reset(&p_data->stats.s_hdr);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(hc_sr04_nrfx_cmds,
+    SHELL_CMD_ARG(stats, NULL, "Show the counters of <device>", cmd_stats, 2, 0),
+    SHELL_CMD_ARG(reset, NULL, "Clear the counters of <device>", cmd_reset, 2, 0),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(hc_sr04_nrfx, &hc_sr04_nrfx_cmds, "HC-SR04_NRFX statistics", NULL);
+#endif
+
+#if CONFIG_HC_SR04_NRFX_MAX_RANGE_MM
+#define UNIT_TIMER_CHECK(timer_idx) \
+    BUILD_ASSERT(NRF_TIMER_CC_CHANNEL_COUNT(timer_idx) > TIMER_TIMEOUT_CHAN, \
+                 "CONFIG_HC_SR04_NRFX_MAX_RANGE_MM requires TIMER3 or TIMER4");
+#else
+#define UNIT_TIMER_CHECK(timer_idx)
+#endif
+
+#define UNIT_DEFINE(name, timer_idx, egu_idx) \
+    BUILD_ASSERT(IS_ENABLED(NRFX_CONCAT_2(CONFIG_NRFX_TIMER, timer_idx)), \
+                 "hc-sr04_nrfx: the TIMER of a timer property must be enabled with CONFIG_NRFX_TIMERn"); \
+    BUILD_ASSERT(IS_ENABLED(NRFX_CONCAT_2(CONFIG_NRFX_EGU, egu_idx)), \
+                 "hc-sr04_nrfx: the EGU of an egu property must be enabled with CONFIG_NRFX_EGUn"); \
+    UNIT_TIMER_CHECK(timer_idx) \
+    static void name##_irq_connect(void) \
+    { \
+        IRQ_CONNECT(DT_IRQN(DT_NODELABEL(NRFX_CONCAT_2(egu, egu_idx))), \
+                DT_IRQ(DT_NODELABEL(NRFX_CONCAT_2(egu, egu_idx)), priority), \
+                nrfx_isr, \
+                NRFX_CONCAT_3(nrfx_egu_, egu_idx, _irq_handler), \
+                0); \
+    } \
+    static struct hc_sr04_nrfx_unit name = { \
+        .timer              = NRFX_TIMER_INSTANCE(timer_idx), \
+        .egu                = NRFX_EGU_INSTANCE(egu_idx), \
+        .timer_irq_priority = DT_IRQ(DT_NODELABEL(NRFX_CONCAT_2(timer, timer_idx)), priority), \
+        .irq_connect        = name##_irq_connect, \
+    }
+
+#if DEFAULT_UNIT_USERS
+UNIT_DEFINE(m_default_unit, CONFIG_HC_SR04_NRFX_TIMER, CONFIG_HC_SR04_NRFX_EGU);
+#endif
+
+#define HAS_OWN_UNIT(n) DT_NODE_HAS_PROP(INST(n), timer)
+
+#define HC_SR04_NRFX_UNIT(n) \
+    BUILD_ASSERT(DT_NODE_HAS_PROP(INST(n), timer) == DT_NODE_HAS_PROP(INST(n), egu), \
+                 "hc-sr04_nrfx: timer and egu must be set together"); \
+    COND_CODE_1(HAS_OWN_UNIT(n), \
+                (UNIT_DEFINE(hc_sr04_nrfx_unit_##n, \
+                             DT_PROP(INST(n), timer), \
+                             DT_PROP(INST(n), egu));), \
+                ())
 
 #define HC_SR04_NRFX_DEVICE(n) \
+    HC_SR04_NRFX_UNIT(n) \
     static const struct hc_sr04_nrfx_cfg hc_sr04_nrfx_cfg_##n = { \
-        .trig_pin = DT_PROP(INST(n), trig_pin), \
-        .echo_pin = DT_PROP(INST(n), echo_pin) \
+        .p_unit     = COND_CODE_1(HAS_OWN_UNIT(n), \
+                                  (&hc_sr04_nrfx_unit_##n), \
+                                  (&m_default_unit)), \
+        .trig_pin   = DT_PROP(INST(n), trig_pin), \
+        .echo_pin   = DT_PROP(INST(n), echo_pin), \
+        .scan_order = DT_PROP_OR(INST(n), scan_order, 0), \
+        .power_pin  = DT_PROP_OR(INST(n), power_pin, POWER_PIN_NONE), \
+        .has_echo_window    = DT_NODE_HAS_PROP(INST(n), echo_window_mm), \
+        .echo_window_min_mm = COND_CODE_1(DT_NODE_HAS_PROP(INST(n), echo_window_mm), \
+                                          (DT_PROP_BY_IDX(INST(n), echo_window_mm, 0)), \
+                                          (0)), \
+        .echo_window_max_mm = COND_CODE_1(DT_NODE_HAS_PROP(INST(n), echo_window_mm), \
+                                          (DT_PROP_BY_IDX(INST(n), echo_window_mm, 1)), \
+                                          (UINT32_MAX)), \
     }; \
     static struct hc_sr04_nrfx_data hc_sr04_nrfx_data_##n; \
-    DEVICE_AND_API_INIT(hc_sr04_nrfx_##n, \
+    DEVICE_DEFINE(hc_sr04_nrfx_##n, \
                 DT_LABEL(INST(n)), \
                 hc_sr04_nrfx_init, \
+                PM_CONTROL, \
                 &hc_sr04_nrfx_data_##n, \
                 &hc_sr04_nrfx_cfg_##n, \
                 POST_KERNEL, \
@@ -566,3 +2489,32 @@ DT_INST_FOREACH_STATUS_OKAY(HC_SR04_NRFX_DEVICE)
 #if DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) == 0
 #warning "HC_SR04_NRFX driver enabled without any devices"
 #endif
+
+/*
+ * Every unit needs a TIMER and an EGU of its own, and the TIMERs must also
+ * differ from the one the GPIO driver captures echo edges with. The bits
+ * of the indices only add up to their OR when no index is used twice.
+ */
+#define UNIT_TIMER_BIT(n)  + COND_CODE_1(HAS_OWN_UNIT(n), (BIT(DT_PROP(INST(n), timer))), (0))
+#define UNIT_EGU_BIT(n)    + COND_CODE_1(HAS_OWN_UNIT(n), (BIT(DT_PROP(INST(n), egu))), (0))
+#define UNIT_TIMER_OR(n)   | COND_CODE_1(HAS_OWN_UNIT(n), (BIT(DT_PROP(INST(n), timer))), (0))
+#define UNIT_EGU_OR(n)     | COND_CODE_1(HAS_OWN_UNIT(n), (BIT(DT_PROP(INST(n), egu))), (0))
+#define DEFAULT_TIMER_BIT  (DEFAULT_UNIT_USERS ? BIT(CONFIG_HC_SR04_NRFX_TIMER) : 0)
+#define DEFAULT_EGU_BIT    (DEFAULT_UNIT_USERS ? BIT(CONFIG_HC_SR04_NRFX_EGU) : 0)
+#if CONFIG_HC_SR04_HW_CAPTURE
+#define CAPTURE_TIMER_BIT  BIT(CONFIG_HC_SR04_HW_CAPTURE_TIMER)
+#else
+#define CAPTURE_TIMER_BIT  0
+#endif
+
+BUILD_ASSERT((CAPTURE_TIMER_BIT + DEFAULT_TIMER_BIT DT_INST_FOREACH_STATUS_OKAY(UNIT_TIMER_BIT)) ==
+             (CAPTURE_TIMER_BIT | DEFAULT_TIMER_BIT DT_INST_FOREACH_STATUS_OKAY(UNIT_TIMER_OR)),
+             "hc-sr04_nrfx: timer properties must differ from each other, from CONFIG_HC_SR04_NRFX_TIMER "
+             "and from CONFIG_HC_SR04_HW_CAPTURE_TIMER");
+BUILD_ASSERT((DEFAULT_EGU_BIT DT_INST_FOREACH_STATUS_OKAY(UNIT_EGU_BIT)) ==
+             (DEFAULT_EGU_BIT DT_INST_FOREACH_STATUS_OKAY(UNIT_EGU_OR)),
+             "hc-sr04_nrfx: egu properties must differ from each other and from CONFIG_HC_SR04_NRFX_EGU");
+
+#if CONFIG_HC_SR04_NRFX_CONTINUOUS && (DEFAULT_UNIT_USERS > 1)
+#error "HC_SR04_NRFX continuous mode supports a single device per TIMER, see the timer property"
+#endif
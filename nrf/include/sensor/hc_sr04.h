@@ -12,9 +12,70 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Attributes of the distance channel.
+ *
+ * Both replace the 340m/s the driver starts with and only affect the
+ * conversion of later measurements.
+ */
+enum hc_sr04_attribute {
+    /** Ambient temperature in degrees Celsius, -40 to 85. */
+    HC_SR04_ATTR_AMBIENT_TEMP = SENSOR_ATTR_PRIV_START,
+    /** Speed of sound in meters per second, 300 to 400. */
+    HC_SR04_ATTR_SPEED_OF_SOUND,
+};
+
 /*
- * NOTE: Does not support attributes or triggers.
+ * NOTE: SENSOR_TRIG_DATA_READY is supported when
+ *       CONFIG_HC_SR04_TRIGGER is enabled: while a handler is installed sample_fetch
+ *       starts a measurement and returns immediately (-EBUSY if a measurement
+ *       is already in progress) and the handler is called from the system work
+ *       queue once the result can be read with sensor_channel_get. Called
+ *       from the handler itself, sample_fetch returns 0 and keeps that result
+ *       instead of starting the next measurement, which has to be started
+ *       from elsewhere.
+ */
+
+/** @brief Timing of a single measurement. */
+struct hc_sr04_timestamps {
+    /** k_cycle_get_32() when the TRIG pulse started. */
+    uint32_t trigger;
+    /** Microseconds from the start of TRIG to the rising echo edge. */
+    uint32_t echo_start;
+    /** Microseconds from the start of TRIG to the falling echo edge. */
+    uint32_t echo_end;
+};
+
+/**
+ * @brief Get the timestamps of the sample returned by sensor_channel_get.
+ *
+ * The trigger time is taken with k_cycle_get_32() right before TRIG is set.
+ * The echo edges are taken with k_cycle_get_32() in the echo GPIO interrupt,
+ * or with CONFIG_HC_SR04_HW_CAPTURE from TIMER captures in microseconds.
+ *
+ * @param dev  HC-SR04 device.
+ * @param p_ts Receives the timestamps of the latest fetched sample.
+ *
+ * @return 0 on success, -EBUSY if the device is not initialized.
+ */
+int hc_sr04_timestamps_get(const struct device *dev, struct hc_sr04_timestamps *p_ts);
+
+/**
+ * @brief Start a measurement without waiting for it.
+ *
+ * Requires CONFIG_HC_SR04_FETCH_ASYNC. The measurement is finished from the
+ * system work queue, which then raises the signal with the result sample_fetch
+ * would have returned (0, -EIO if the sensor didn't respond). The sample can
+ * then be read with sensor_channel_get. A DATA_READY handler, if installed, is
+ * called as well.
+ *
+ * @param dev    HC-SR04 device.
+ * @param signal Raised on completion. Must stay valid until then.
+ *
+ * @return 0 if the measurement was started, -EBUSY if another one is in
+ *         progress or another negative errno.
  */
+int hc_sr04_fetch_async(const struct device *dev, struct k_poll_signal *signal);
 
 #ifdef __cplusplus
 }
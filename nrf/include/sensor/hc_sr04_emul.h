@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+#ifndef ZEPHYR_INCLUDE_HC_SR04_EMUL_H_
+#define ZEPHYR_INCLUDE_HC_SR04_EMUL_H_
+
+#include <kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * NOTE: The emulator is a GPIO controller. Every falling edge on its TRIG
+ *       pin is answered with the configured echo on its echo pin, timed
+ *       with a kernel timer and reported through the GPIO callbacks like
+ *       a real pin-change interrupt. Like the real module, TRIG is ignored
+ *       until the previous echo, including its spurious pulse, has ended.
+ *       Until hc_sr04_emul_echo_set() is called it faces a wall one meter
+ *       away.
+ */
+
+/** Spurious pulse seen after an invalid (timed out) echo. */
+#define HC_SR04_EMUL_SPURIOUS_DELAY_US 145
+#define HC_SR04_EMUL_SPURIOUS_WIDTH_US 6
+
+/** Default echo, a round trip of one meter at 340 m/s. */
+#define HC_SR04_EMUL_DELAY_US          500
+#define HC_SR04_EMUL_WIDTH_US          5882
+
+/** @brief Echo answered to a TRIG. */
+struct hc_sr04_emul_echo {
+    /** Microseconds from the falling TRIG edge to the rising echo edge. */
+    uint32_t delay_us;
+    /** Echo width in microseconds, 0 for no response. */
+    uint32_t width_us;
+    /** Follow the echo with the spurious pulse. */
+    bool     spurious;
+};
+
+/**
+ * @brief Set the echo answered to every following TRIG.
+ *
+ * @param p_echo Echo to answer with.
+ */
+void hc_sr04_emul_echo_set(const struct hc_sr04_emul_echo *p_echo);
+
+/**
+ * @brief Get the number of falling TRIG edges seen, ignored ones included.
+ */
+uint32_t hc_sr04_emul_trig_count(void);
+
+/**
+ * @brief Check whether an echo is still being played.
+ */
+bool hc_sr04_emul_busy(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_INCLUDE_HC_SR04_EMUL_H_ */
@@ -7,14 +7,259 @@
 #define ZEPHYR_INCLUDE_HC_SR04_NRFX_H_
 
 #include <drivers/sensor.h>
+#include <sys/ring_buffer.h>
+#include <sys/slist.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Attributes of the distance channel.
+ *
+ * The first two replace the 340m/s the driver starts with and only affect
+ * the conversion of later measurements. The filter attributes require
+ * CONFIG_HC_SR04_NRFX_FILTER and restart the filter when the window changes.
+ * The maximum range is kept per device.
+ */
+enum hc_sr04_nrfx_attribute {
+    /** Ambient temperature in degrees Celsius, -40 to 85. */
+    HC_SR04_NRFX_ATTR_AMBIENT_TEMP = SENSOR_ATTR_PRIV_START,
+    /** Speed of sound in meters per second, 300 to 400. */
+    HC_SR04_NRFX_ATTR_SPEED_OF_SOUND,
+    /** Median window in captures, 1 to CONFIG_HC_SR04_NRFX_FILTER_MEDIAN_SIZE. */
+    HC_SR04_NRFX_ATTR_MEDIAN_WINDOW,
+    /** Moving average weight of a new median, above 0 up to 1. */
+    HC_SR04_NRFX_ATTR_EMA_ALPHA,
+    /**
+     * Maximum range in meters, 0.02 to 4 or 0 for the full range. Longer
+     * echoes make sample_fetch return -ERANGE. With
+     * CONFIG_HC_SR04_NRFX_MAX_RANGE_MM the measurement is also aborted at
+     * this range if it is shorter than the configured one.
+     */
+    HC_SR04_NRFX_ATTR_MAX_RANGE,
+};
+
+/** @brief Channels provided next to SENSOR_CHAN_DISTANCE. */
+enum hc_sr04_nrfx_channel {
+    /**
+     * Closing velocity in meters per second, positive while the distance
+     * decreases. Requires CONFIG_HC_SR04_NRFX_VELOCITY and is averaged over
+     * the latest CONFIG_HC_SR04_NRFX_VELOCITY_SAMPLES valid fetched samples.
+     * sensor_channel_get returns -ENODATA until two of them are available.
+     */
+    HC_SR04_NRFX_CHAN_VELOCITY = SENSOR_CHAN_PRIV_START,
+};
+
 /*
- * NOTE: Does not support attributes or triggers.
+ * NOTE: SENSOR_TRIG_DATA_READY is supported when
+ *       CONFIG_HC_SR04_NRFX_TRIGGER is enabled: while a handler is installed sample_fetch
+ *       starts a measurement and returns immediately (-EBUSY if a measurement
+ *       is already in progress) and the handler is called from the system work
+ *       queue once the result can be read with sensor_channel_get. Called
+ *       from the handler itself, sample_fetch returns 0 and keeps that result
+ *       instead of starting the next measurement, which has to be started
+ *       from elsewhere.
+ */
+
+/*
+ * NOTE: With CONFIG_HC_SR04_NRFX_MAX_RANGE_MM set, measurements without an echo
+ *       inside the configured range are aborted by a TIMER compare and
+ *       sample_fetch returns -ERANGE.
+ */
+
+/*
+ * NOTE: With CONFIG_DEVICE_POWER_MANAGEMENT the device can be suspended, e.g.
+ *       with device_pm_put, which stops the TIMER and the echo GPIOTE event
+ *       where they would otherwise keep running and drives the optional
+ *       power-pin low. Fetching from a suspended device returns -EIO and
+ *       suspending returns -EBUSY while a measurement is in progress.
+ */
+
+/** @brief Timing of a single measurement. */
+struct hc_sr04_nrfx_timestamps {
+    /** k_cycle_get_32() when the TRIG pulse started. */
+    uint32_t trigger;
+    /** Microseconds from the start of TRIG to the rising echo edge. */
+    uint32_t echo_start;
+    /** Microseconds from the start of TRIG to the falling echo edge. */
+    uint32_t echo_end;
+};
+
+/** @brief Encoded sample written by the stream and passed to listeners. */
+struct hc_sr04_nrfx_sample {
+    /** k_cycle_get_32() when the TRIG pulse started. */
+    uint32_t trigger;
+    /** Raw echo width in microseconds, 25000us or more is an invalid measurement. */
+    uint32_t width;
+};
+
+/**
+ * @brief Called with every completed measurement.
+ *
+ * @param dev       HC-SR04_NRFX device.
+ * @param sample    The measurement, only valid during the call. Invalid
+ *                  measurements are included, see hc_sr04_nrfx_sample_decode.
+ * @param user_data From the listener.
+ */
+typedef void (*hc_sr04_nrfx_listener_handler_t)(const struct device *dev,
+                                                const struct hc_sr04_nrfx_sample *sample,
+                                                void *user_data);
+
+/** @brief Measurement listener, see hc_sr04_nrfx_listener_add. */
+struct hc_sr04_nrfx_listener {
+    /** Used by the driver. */
+    sys_snode_t node;
+    /** Called with every published measurement. */
+    hc_sr04_nrfx_listener_handler_t handler;
+    /** Passed to the handler. */
+    void *user_data;
+};
+
+/** Burst width recorded for a measurement aborted by the max range timeout. */
+#define HC_SR04_NRFX_WIDTH_OUT_OF_RANGE UINT32_MAX
+
+/**
+ * @brief Collect consecutive raw echo widths.
+ *
+ * The EGU interrupt stores every capture and re-fires TRIG on its own so the
+ * calling thread is only woken up once the whole burst has completed. In
+ * continuous mode the next n periodic captures are collected instead. Only
+ * those are also published to listeners.
+ *
+ * @param dev    HC-SR04_NRFX device.
+ * @param widths Buffer receiving the echo widths in microseconds. Widths of
+ *               25000us or more are invalid measurements, see also
+ *               HC_SR04_NRFX_WIDTH_OUT_OF_RANGE. The echo-window-mm DT
+ *               property is not applied.
+ * @param n      Number of widths to collect.
+ *
+ * @return Number of widths collected (fewer than n if the sensor stopped
+ *         responding), -EIO if none were collected or another negative errno.
+ */
+int hc_sr04_nrfx_read_burst(const struct device *dev, uint32_t *widths, size_t n);
+
+/**
+ * @brief Get the timestamps of the sample returned by sensor_channel_get.
+ *
+ * The echo edges are TIMER captures with microsecond resolution. The trigger
+ * time has the resolution of the kernel cycle counter and lets readings be
+ * aligned with other sensors.
+ *
+ * @param dev  HC-SR04_NRFX device.
+ * @param p_ts Receives the timestamps of the latest fetched sample.
+ *
+ * @return 0 on success, -EBUSY if the device is not initialized.
+ */
+int hc_sr04_nrfx_timestamps_get(const struct device *dev, struct hc_sr04_nrfx_timestamps *p_ts);
+
+/**
+ * @brief Start a measurement without waiting for it.
+ *
+ * Requires CONFIG_HC_SR04_NRFX_FETCH_ASYNC. The signal is raised from the
+ * system work queue with the result sample_fetch would have returned once the
+ * EGU interrupt has reported the capture or the sensor didn't respond. The
+ * sample can then be read with sensor_channel_get. In continuous and scheduler
+ * mode sample_fetch doesn't wait for the sensor, so the signal is raised
+ * before this returns.
+ *
+ * @param dev    HC-SR04_NRFX device.
+ * @param signal Raised on completion. Must stay valid until then.
+ *
+ * @return 0 if the measurement was started, -EBUSY if another one is in
+ *         progress on the same TIMER or another negative errno.
+ */
+int hc_sr04_nrfx_fetch_async(const struct device *dev, struct k_poll_signal *signal);
+
+/**
+ * @brief Stream every capture into a ring buffer.
+ *
+ * Requires CONFIG_HC_SR04_NRFX_STREAM. The EGU interrupt appends one
+ * struct hc_sr04_nrfx_sample per capture and drops samples that don't fit.
+ * The consumer reads whole samples with ring_buf_get, for instance from a
+ * DATA_READY handler or periodically, and converts them with
+ * hc_sr04_nrfx_sample_decode.
+ *
+ * @param dev HC-SR04_NRFX device.
+ * @param buf Ring buffer that stays valid until the stream is stopped.
+ *
+ * @return 0 on success, -EALREADY if a stream is running or another
+ *         negative errno.
+ */
+int hc_sr04_nrfx_stream_start(const struct device *dev, struct ring_buf *buf);
+
+/**
+ * @brief Stop streaming.
+ *
+ * @param dev HC-SR04_NRFX device.
+ *
+ * @return Number of samples dropped because the ring buffer was full, or a
+ *         negative errno.
+ */
+int hc_sr04_nrfx_stream_stop(const struct device *dev);
+
+/**
+ * @brief Subscribe to every measurement of a device.
+ *
+ * Requires CONFIG_HC_SR04_NRFX_LISTENERS. Measurements are published where
+ * they complete: by whichever fetch, work queue handler or scheduler sweep
+ * finished them in one-shot mode and from the EGU interrupt in continuous
+ * mode, so a single ping serves all listeners. Measurements aborted by the
+ * max range timeout or that a fetch would reject with -ERANGE (beyond
+ * HC_SR04_NRFX_ATTR_MAX_RANGE or outside the echo-window-mm DT property) are
+ * not published, nor are one-shot captures collected by
+ * hc_sr04_nrfx_read_burst, which only go to its caller. Handlers must not
+ * block or add and remove listeners.
+ *
+ * @param dev      HC-SR04_NRFX device.
+ * @param listener Must stay valid until it is removed.
+ *
+ * @return 0 on success, -EINVAL if the listener has no handler.
+ */
+int hc_sr04_nrfx_listener_add(const struct device *dev, struct hc_sr04_nrfx_listener *listener);
+
+/**
+ * @brief Unsubscribe a listener.
+ *
+ * @param dev      HC-SR04_NRFX device.
+ * @param listener Listener added with hc_sr04_nrfx_listener_add.
+ *
+ * @return 0 on success, -ENOENT if the listener wasn't added.
+ */
+int hc_sr04_nrfx_listener_remove(const struct device *dev, struct hc_sr04_nrfx_listener *listener);
+
+/**
+ * @brief Convert a streamed or published sample to a distance.
+ *
+ * Uses the device's current speed of sound.
+ *
+ * @param dev    HC-SR04_NRFX device the sample was taken by.
+ * @param sample Sample to convert.
+ * @param val    Receives the distance in meters, zero for invalid samples.
+ *
+ * @return 0 on success, -ERANGE if the sample is an invalid measurement.
+ */
+int hc_sr04_nrfx_sample_decode(const struct device *dev,
+                               const struct hc_sr04_nrfx_sample *sample,
+                               struct sensor_value *val);
+
+/**
+ * @brief Estimate the module's average supply current.
+ *
+ * Based on CONFIG_HC_SR04_NRFX_ACTIVE_CURRENT_UA while ranging and
+ * CONFIG_HC_SR04_NRFX_IDLE_CURRENT_UA otherwise, taking the length of the
+ * latest fetched measurement for all of them. A device with a power-pin is
+ * assumed to be suspended between measurements, so it only draws current
+ * for CONFIG_HC_SR04_NRFX_POWER_ON_DELAY_MS before each one.
+ *
+ * @param dev       HC-SR04_NRFX device.
+ * @param period_ms Time between the starts of two measurements.
+ * @param p_ua      Receives the average current in microamperes.
+ *
+ * @return 0 on success, -ENODATA if nothing has been fetched yet or -EINVAL
+ *         if a measurement doesn't fit into the period.
  */
+int hc_sr04_nrfx_current_estimate(const struct device *dev, uint32_t period_ms, uint32_t *p_ua);
 
 #ifdef __cplusplus
 }
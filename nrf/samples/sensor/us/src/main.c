@@ -36,6 +36,9 @@ static int measure(const struct device *dev)
     case -EIO:
         LOG_WRN("%s: Could not read device", dev->name);
         break;
+    case -ERANGE:
+        LOG_INF("%s: Out of range", dev->name);
+        break;
     default:
         LOG_ERR("Error when reading device: %s", dev->name);
         break;
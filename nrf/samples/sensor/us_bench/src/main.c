@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2020 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/sensor.h>
+#include <string.h>
+#if CONFIG_HC_SR04
+#include <sensor/hc_sr04.h>
+#else
+#include <sensor/hc_sr04_nrfx.h>
+#endif
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
+
+#define BENCH_DURATION_MS     10000
+#define BENCH_CALIBRATE_MS    1000
+#define BENCH_MAX_SAMPLES     1024 /* Latencies kept for the p99, see latency_record */
+#define BENCH_POLL_MS         1 /* Wait for a new sample in continuous and scheduler mode */
+
+#define SPIN_STACK_SIZE       256
+#define SPIN_PRIORITY         K_LOWEST_APPLICATION_THREAD_PRIO
+
+struct bench_result {
+    uint32_t fetches;
+    uint32_t repeated;     /* Returned the previous sample again */
+    uint32_t valid;
+    uint32_t invalid;      /* Distance 0, no echo within range */
+    uint32_t timeouts;     /* -EIO */
+    uint32_t out_of_range; /* -ERANGE */
+    uint32_t errors;
+    uint32_t spin_count;
+    uint32_t latency_min;  /* Cycles, of every fetch that wasn't repeated */
+    uint64_t latency_sum;
+};
+
+static uint32_t          m_latencies[BENCH_MAX_SAMPLES]; /* Cycles */
+static uint32_t          m_rand_state = 2463534242;
+static volatile uint32_t m_spin_count;
+
+/*
+ * Runs whenever nothing else does. Comparing its progress with and without the
+ * benchmark running gives the CPU time spent by the driver, in its interrupts
+ * and in the fetching thread together.
+ */
+static void spin_thread(void *p1, void *p2, void *p3)
+{
+    for (;;) {
+        m_spin_count++;
+#if CONFIG_ARCH_POSIX
+        /* Simulated time only advances while the CPU waits. */
+        k_busy_wait(1);
+#endif
+    }
+}
+
+K_THREAD_DEFINE(spin, SPIN_STACK_SIZE, spin_thread, NULL, NULL, NULL, SPIN_PRIORITY, 0, 0);
+
+static void latencies_sort(uint32_t *p_values, size_t count)
+{
+    uint32_t value;
+    size_t   i;
+    size_t   j;
+
+    for (i = 1; i < count; i++) {
+        value = p_values[i];
+        for (j = i; (0 < j) && (p_values[j - 1] > value); j--) {
+            p_values[j] = p_values[j - 1];
+        }
+        p_values[j] = value;
+    }
+}
+
+static uint32_t rand_next(void)
+{
+    /* xorshift32, only used to pick reservoir slots */
+    m_rand_state ^= (m_rand_state << 13);
+    m_rand_state ^= (m_rand_state >> 17);
+    m_rand_state ^= (m_rand_state << 5);
+    return m_rand_state;
+}
+
+/*
+ * Min and mean cover every latency. m_latencies keeps a uniform random
+ * sample of them (reservoir sampling) for the p99, so a run with more than
+ * BENCH_MAX_SAMPLES samples isn't summarized by its start only.
+ */
+static void latency_record(struct bench_result *p_result, uint32_t idx, uint32_t latency)
+{
+    uint32_t slot;
+
+    p_result->latency_sum += latency;
+    if ((0 == idx) || (p_result->latency_min > latency)) {
+        p_result->latency_min = latency;
+    }
+
+    if (BENCH_MAX_SAMPLES > idx) {
+        m_latencies[idx] = latency;
+        return;
+    }
+    slot = (rand_next() % (idx + 1));
+    if (BENCH_MAX_SAMPLES > slot) {
+        m_latencies[slot] = latency;
+    }
+}
+
+static int trigger_time_get(const struct device *dev, uint32_t *p_trigger)
+{
+    int err;
+#if CONFIG_HC_SR04
+    struct hc_sr04_timestamps ts;
+
+    err = hc_sr04_timestamps_get(dev, &ts);
+#else
+    struct hc_sr04_nrfx_timestamps ts;
+
+    err = hc_sr04_nrfx_timestamps_get(dev, &ts);
+#endif
+    *p_trigger = ts.trigger;
+    return err;
+}
+
+/*
+ * Returns true if the fetch produced a sample that hasn't been counted yet.
+ * In continuous and scheduler mode sample_fetch returns the latest cached
+ * sample without waiting, so the same one can come back many times.
+ */
+static bool sample_is_new(const struct device *dev, uint32_t *p_last_trigger)
+{
+    uint32_t trigger;
+
+    if ((0 != trigger_time_get(dev, &trigger)) || (trigger == *p_last_trigger)) {
+        return false;
+    }
+    *p_last_trigger = trigger;
+    return true;
+}
+
+static void bench_run(const struct device *dev, struct bench_result *p_result)
+{
+    int                 ret;
+    uint32_t            start;
+    uint32_t            latency;
+    uint32_t            count = 0;
+    uint32_t            last_trigger;
+    int64_t             end;
+    struct sensor_value distance;
+
+    memset(p_result, 0, sizeof(*p_result));
+    (void) trigger_time_get(dev, &last_trigger);
+
+    m_spin_count = 0;
+    end = (k_uptime_get() + BENCH_DURATION_MS);
+    while (k_uptime_get() < end) {
+        start   = k_cycle_get_32();
+        ret     = sensor_sample_fetch_chan(dev, SENSOR_CHAN_ALL);
+        latency = (k_cycle_get_32() - start);
+        p_result->fetches++;
+
+        if ((0 == ret) && !sample_is_new(dev, &last_trigger)) {
+            p_result->repeated++;
+            k_msleep(BENCH_POLL_MS);
+            continue;
+        }
+
+        /* Timeouts and errors included, they cost the caller as much. */
+        latency_record(p_result, count, latency);
+        count++;
+
+        switch (ret) {
+        case 0:
+            (void) sensor_channel_get(dev, SENSOR_CHAN_DISTANCE, &distance);
+            if ((0 == distance.val1) && (0 == distance.val2)) {
+                p_result->invalid++;
+            } else {
+                p_result->valid++;
+            }
+            break;
+        case -EIO:
+            p_result->timeouts++;
+            break;
+        case -ERANGE:
+            p_result->out_of_range++;
+            break;
+        default:
+            p_result->errors++;
+            break;
+        }
+    }
+    p_result->spin_count = m_spin_count;
+}
+
+static void bench_report(const struct device *dev,
+                         const struct bench_result *p_result,
+                         uint32_t idle_spin_count)
+{
+    uint32_t samples = (p_result->fetches - p_result->repeated);
+    uint32_t count   = MIN(samples, BENCH_MAX_SAMPLES);
+    uint32_t busy_permille;
+    uint32_t busy_us_per_sample;
+
+    if (0 == count) {
+        LOG_ERR("%s: No fetches completed", dev->name);
+        return;
+    }
+
+    latencies_sort(m_latencies, count);
+
+    if (p_result->spin_count < idle_spin_count) {
+        busy_permille = (1000 - (uint32_t)(((uint64_t)p_result->spin_count * 1000) /
+                                           idle_spin_count));
+    } else {
+        busy_permille = 0;
+    }
+    busy_us_per_sample = (uint32_t)(((uint64_t)busy_permille * BENCH_DURATION_MS) / samples);
+
+    LOG_INF("%s: %u samples from %u fetches in %ums, %u valid, %u invalid, %u timeouts, "
+            "%u out of range, %u errors",
+            dev->name, samples, p_result->fetches, BENCH_DURATION_MS, p_result->valid,
+            p_result->invalid, p_result->timeouts, p_result->out_of_range, p_result->errors);
+    LOG_INF("%s: %u.%02u valid samples/s, timeout rate %u.%01u%%",
+            dev->name,
+            (p_result->valid * 1000 / BENCH_DURATION_MS),
+            ((p_result->valid * 100000 / BENCH_DURATION_MS) % 100),
+            (p_result->timeouts * 100 / samples),
+            ((p_result->timeouts * 1000 / samples) % 10));
+    LOG_INF("%s: fetch latency of all %u samples, failed ones included: "
+            "min %uus, mean %uus, p99 %uus (of %u picked at random)",
+            dev->name, samples,
+            k_cyc_to_us_near32(p_result->latency_min),
+            k_cyc_to_us_near32((uint32_t)(p_result->latency_sum / samples)),
+            k_cyc_to_us_near32(m_latencies[((count * 99) / 100)]),
+            count);
+    LOG_INF("%s: CPU busy %u.%01u%%, ~%uus per sample",
+            dev->name, (busy_permille / 10), (busy_permille % 10), busy_us_per_sample);
+}
+
+void main(void)
+{
+    const struct device *dev;
+    struct bench_result  result;
+    uint32_t             idle_spin_count;
+
+    if (IS_ENABLED(CONFIG_LOG_BACKEND_RTT)) {
+        /* Give RTT log time to be flushed before executing tests */
+        k_sleep(K_MSEC(500));
+    }
+
+#if CONFIG_HC_SR04
+    dev = device_get_binding("HC-SR04_0");
+#else
+    dev = device_get_binding("HC-SR04_NRFX_0");
+#endif
+
+    if (dev == NULL) {
+        LOG_ERR("Failed to get dev binding");
+        return;
+    }
+
+    /* Progress of the spin thread over the benchmark duration when idle */
+    m_spin_count = 0;
+    k_msleep(BENCH_CALIBRATE_MS);
+    idle_spin_count = (uint32_t)(((uint64_t)m_spin_count * BENCH_DURATION_MS) /
+                                 BENCH_CALIBRATE_MS);
+
+    LOG_INF("%s: running back-to-back fetches for %ums", dev->name, BENCH_DURATION_MS);
+    bench_run(dev, &result);
+    bench_report(dev, &result, idle_spin_count);
+}
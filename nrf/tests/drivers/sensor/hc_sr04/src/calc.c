@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ztest.h>
+
+#define HC_SR04_FILTER_SIZE   5
+#define HC_SR04_HISTORY_SIZE  4
+
+#include "hc_sr04_calc.h"
+
+#define VELOCITY_PERIOD_US    100000
+
+void test_speed_to_scale(void)
+{
+    struct sensor_value value;
+
+    /* 340 m/s is 170 um per microsecond of round trip. */
+    zassert_equal(SPEED_TO_SCALE(340000), (170 << SCALE_SHIFT), "wrong scale");
+
+    zassert_true(count_to_sensor_value(SPEED_TO_SCALE(340000), 5882, &value), "valid count");
+    zassert_equal(value.val1, 0, "wrong meters");
+    zassert_equal(value.val2, 999940, "wrong micrometers");
+
+    zassert_true(count_to_sensor_value(SPEED_TO_SCALE(340000), 11765, &value), "valid count");
+    zassert_equal(value.val1, 2, "wrong meters");
+    zassert_equal(value.val2, 50, "wrong micrometers");
+
+    /* 331.3 m/s at 0 C */
+    zassert_true(count_to_sensor_value(SPEED_TO_SCALE(331300), 5882, &value), "valid count");
+    zassert_equal(value.val1, 0, "wrong meters");
+    zassert_equal(value.val2, 974353, "wrong micrometers");
+}
+
+void test_count_bounds(void)
+{
+    struct sensor_value value = { .val1 = 1, .val2 = 1 };
+
+    zassert_false(count_to_sensor_value(SPEED_TO_SCALE(340000), T_TRIG_PULSE_US, &value),
+                  "TRIG length echo is invalid");
+    zassert_equal(value.val1, 0, "invalid echo must read as zero");
+    zassert_equal(value.val2, 0, "invalid echo must read as zero");
+
+    zassert_true(count_is_valid(T_TRIG_PULSE_US + 1), "shortest valid echo");
+    zassert_true(count_is_valid(T_INVALID_PULSE_US - 1), "longest valid echo");
+    zassert_false(count_is_valid(T_INVALID_PULSE_US), "timed out echo is invalid");
+    zassert_false(count_is_valid(128600), "no echo pulse is invalid");
+}
+
+void test_timer_count_wrap(void)
+{
+    zassert_true(timer_count_before(5, 6), "5 before 6");
+    zassert_false(timer_count_before(6, 5), "6 after 5");
+    zassert_false(timer_count_before(7, 7), "equal counts");
+
+    /* The 24-bit TIMER wraps to 0. */
+    zassert_true(timer_count_before(0xFFFFF0, 0x000010), "count before the wrap");
+    zassert_false(timer_count_before(0x000010, 0xFFFFF0), "count after the wrap");
+    zassert_true(timer_count_before(0xFF000005, 0x000006), "upper byte is ignored");
+}
+
+void test_filter_median(void)
+{
+    struct hc_sr04_filter filter = { .len = 5, .alpha = EMA_ONE };
+
+    filter_reset(&filter);
+    filter_add(&filter, 100);
+    zassert_equal(filter_output_get(&filter), 100, "first sample");
+    filter_add(&filter, 300);
+    zassert_equal(filter_output_get(&filter), 300, "upper median of two");
+    filter_add(&filter, 200);
+    zassert_equal(filter_output_get(&filter), 200, "median of three");
+    filter_add(&filter, 10000);
+    zassert_equal(filter_output_get(&filter), 300, "upper median of four");
+    filter_add(&filter, 150);
+    zassert_equal(filter_output_get(&filter), 200, "spike must be rejected");
+}
+
+void test_filter_window(void)
+{
+    struct hc_sr04_filter filter = { .len = 3, .alpha = EMA_ONE };
+
+    filter_reset(&filter);
+    filter_add(&filter, 1000);
+    filter_add(&filter, 1000);
+    filter_add(&filter, 1000);
+    filter_add(&filter, 10);
+    zassert_equal(filter_output_get(&filter), 1000, "older samples still win");
+    filter_add(&filter, 10);
+    zassert_equal(filter_output_get(&filter), 10, "oldest samples must drop out");
+    zassert_equal(filter.count, 3, "window must not grow past its length");
+}
+
+void test_filter_ema(void)
+{
+    struct hc_sr04_filter filter = { .len = 1, .alpha = (EMA_ONE / 2) };
+
+    filter_reset(&filter);
+    filter_add(&filter, 100);
+    zassert_equal(filter_output_get(&filter), 100, "EMA starts at the first sample");
+    filter_add(&filter, 200);
+    zassert_equal(filter_output_get(&filter), 150, "wrong EMA");
+    filter_add(&filter, 200);
+    zassert_equal(filter_output_get(&filter), 175, "wrong EMA");
+    filter_add(&filter, 100);
+    zassert_equal(filter_output_get(&filter), 138, "EMA must round to nearest");
+
+    filter_reset(&filter);
+    filter_add(&filter, 40);
+    zassert_equal(filter_output_get(&filter), 40, "reset must restart the EMA");
+}
+
+void test_velocity(void)
+{
+    struct hc_sr04_history history;
+    struct sensor_value    value;
+    uint32_t               t0 = 0xFFFFFF00; /* Across a cycle counter wrap */
+
+    history_reset(&history);
+    zassert_equal(history_velocity_get(&history, &value), -ENODATA, "no samples");
+    history_add(&history, t0, 1000000);
+    zassert_equal(history_velocity_get(&history, &value), -ENODATA, "one sample");
+    history_add(&history, t0, 900000);
+    zassert_equal(history_velocity_get(&history, &value), -ENODATA,
+                  "a sample returned again must be ignored");
+
+    history_add(&history, (t0 + k_us_to_cyc_near32(VELOCITY_PERIOD_US)), 990000);
+    zassert_equal(history_velocity_get(&history, &value), 0, "two samples");
+    zassert_equal(value.val1, 0, "wrong velocity");
+    zassert_equal(value.val2, 100000, "closing in must be positive");
+
+    history_reset(&history);
+    history_add(&history, t0, 1000000);
+    history_add(&history, (t0 + k_us_to_cyc_near32(5 * VELOCITY_PERIOD_US)), 1250000);
+    zassert_equal(history_velocity_get(&history, &value), 0, "two samples");
+    zassert_equal(value.val1, 0, "wrong velocity");
+    zassert_equal(value.val2, -500000, "moving away must be negative");
+}
+
+void test_velocity_ring(void)
+{
+    static const int32_t um[] = { 0, 0, 1000000, 990000, 980000, 970000 };
+
+    struct hc_sr04_history history;
+    struct sensor_value    value;
+    size_t                 i;
+
+    history_reset(&history);
+    for (i = 0; i < ARRAY_SIZE(um); i++) {
+        history_add(&history, k_us_to_cyc_near32(i * VELOCITY_PERIOD_US), um[i]);
+    }
+    zassert_equal(history.count, HC_SR04_HISTORY_SIZE, "ring must not grow past its size");
+
+    /* The two oldest samples have been overwritten. */
+    zassert_equal(history_velocity_get(&history, &value), 0, "full ring");
+    zassert_equal(value.val1, 0, "wrong velocity");
+    zassert_equal(value.val2, 100000, "wrong velocity");
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Daniel Veilleux
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <ztest.h>
+#include <device.h>
+#include <drivers/sensor.h>
+#include <sensor/hc_sr04.h>
+
+#include <sensor/hc_sr04_emul.h>
+
+#define TRIG_PULSE_US         11
+#define ECHO_DELAY_US         500
+#define ONE_METER_US          5882    /* Round trip at the driver's default 340 m/s */
+#define ONE_METER_UM          999940
+#define HALF_METER_US         2941
+#define INVALID_PULSE_US      128600  /* What the sensor sends when nothing echoes */
+#define TIMEOUT_MS            130     /* Driver gives up on the echo */
+#define TIMING_TOLERANCE_US   30      /* Two 10 us ticks of echo timing plus TRIG */
+#define DISTANCE_TOLERANCE_UM (TIMING_TOLERANCE_US * 170)
+#define RATE_TEST_MS          1000
+#define RATE_MIN_HZ           250     /* A half meter echo ends ~3.5 ms after TRIG */
+
+extern void test_speed_to_scale(void);
+extern void test_count_bounds(void);
+extern void test_timer_count_wrap(void);
+extern void test_filter_median(void);
+extern void test_filter_window(void);
+extern void test_filter_ema(void);
+extern void test_velocity(void);
+extern void test_velocity_ring(void);
+
+static const struct device *m_dev;
+static K_SEM_DEFINE(m_data_ready_sem, 0, 1);
+static int     m_data_ready_err;
+static int32_t m_data_ready_um;
+
+static void echo_set(uint32_t width_us, bool spurious)
+{
+    const struct hc_sr04_emul_echo echo = {
+        .delay_us = ECHO_DELAY_US,
+        .width_us = width_us,
+        .spurious = spurious,
+    };
+
+    hc_sr04_emul_echo_set(&echo);
+}
+
+static int32_t distance_um_get(void)
+{
+    struct sensor_value value;
+
+    zassert_equal(sensor_channel_get(m_dev, SENSOR_CHAN_DISTANCE, &value), 0,
+                  "channel_get failed");
+    return ((value.val1 * 1000000) + value.val2);
+}
+
+/* Lets a previous test's echo end before the next TRIG. */
+static void sensor_idle_wait(void)
+{
+    while (hc_sr04_emul_busy()) {
+        k_msleep(1);
+    }
+}
+
+static void test_valid_echo(void)
+{
+    struct hc_sr04_timestamps ts;
+
+    echo_set(ONE_METER_US, false);
+    zassert_equal(sensor_sample_fetch(m_dev), 0, "fetch failed");
+    zassert_within(distance_um_get(), ONE_METER_UM, DISTANCE_TOLERANCE_UM, "wrong distance");
+
+    zassert_equal(hc_sr04_timestamps_get(m_dev, &ts), 0, "timestamps_get failed");
+    zassert_within(ts.echo_start, (TRIG_PULSE_US + ECHO_DELAY_US), TIMING_TOLERANCE_US,
+                   "wrong echo start %u", ts.echo_start);
+    zassert_within((ts.echo_end - ts.echo_start), ONE_METER_US, TIMING_TOLERANCE_US,
+                   "wrong echo width %u", (ts.echo_end - ts.echo_start));
+}
+
+static void test_invalid_pulse(void)
+{
+    echo_set(INVALID_PULSE_US, true);
+    zassert_equal(sensor_sample_fetch(m_dev), 0, "fetch failed");
+    zassert_equal(distance_um_get(), 0, "invalid pulse must read as zero");
+}
+
+static void test_spurious_pulse(void)
+{
+    uint32_t trig_count;
+
+    echo_set(INVALID_PULSE_US, true);
+    zassert_equal(sensor_sample_fetch(m_dev), 0, "fetch failed");
+    zassert_equal(distance_um_get(), 0, "invalid pulse must read as zero");
+
+    /* The next TRIG must not land in, or measure, the spurious pulse. */
+    trig_count = hc_sr04_emul_trig_count();
+    echo_set(ONE_METER_US, false);
+    zassert_equal(sensor_sample_fetch(m_dev), 0, "fetch failed");
+    zassert_within(distance_um_get(), ONE_METER_UM, DISTANCE_TOLERANCE_UM, "wrong distance");
+    zassert_equal(hc_sr04_emul_trig_count(), (trig_count + 1), "TRIG not sent once");
+}
+
+static void test_no_response(void)
+{
+    int64_t start;
+
+    echo_set(0, false);
+    start = k_uptime_get();
+    zassert_equal(sensor_sample_fetch(m_dev), -EIO, "missing echo must time out");
+    zassert_true((k_uptime_get() - start) >= TIMEOUT_MS, "timed out early");
+
+    /* A timeout doesn't wedge the driver. */
+    echo_set(ONE_METER_US, false);
+    zassert_equal(sensor_sample_fetch(m_dev), 0, "fetch failed");
+    zassert_within(distance_um_get(), ONE_METER_UM, DISTANCE_TOLERANCE_UM, "wrong distance");
+}
+
+static void test_sample_rate(void)
+{
+    uint32_t count = 0;
+    int64_t  end;
+
+    echo_set(HALF_METER_US, false);
+    end = (k_uptime_get() + RATE_TEST_MS);
+    while (k_uptime_get() < end) {
+        zassert_equal(sensor_sample_fetch(m_dev), 0, "fetch failed");
+        count++;
+    }
+    zassert_true(((count * 1000) / RATE_TEST_MS) >= RATE_MIN_HZ, "%u samples/s", count);
+    zassert_within(distance_um_get(), (ONE_METER_UM / 2), DISTANCE_TOLERANCE_UM,
+                   "wrong distance");
+}
+
+/* The conventional handler body: fetch, then read the channel. */
+static void data_ready_handler(const struct device *dev, struct sensor_trigger *trig)
+{
+    struct sensor_value value;
+
+    m_data_ready_err = sensor_sample_fetch(dev);
+    (void) sensor_channel_get(dev, SENSOR_CHAN_DISTANCE, &value);
+    m_data_ready_um = ((value.val1 * 1000000) + value.val2);
+    k_sem_give(&m_data_ready_sem);
+}
+
+static void test_data_ready(void)
+{
+    struct sensor_trigger trig = {
+        .type = SENSOR_TRIG_DATA_READY,
+        .chan = SENSOR_CHAN_DISTANCE,
+    };
+    uint32_t trig_count;
+
+    echo_set(HALF_METER_US, false);
+    zassert_equal(sensor_trigger_set(m_dev, &trig, data_ready_handler), 0,
+                  "trigger_set failed");
+    trig_count = hc_sr04_emul_trig_count();
+    zassert_equal(sensor_sample_fetch(m_dev), 0, "fetch failed");
+    zassert_equal(k_sem_take(&m_data_ready_sem, K_MSEC(TIMEOUT_MS)), 0, "no DATA_READY");
+    zassert_equal(m_data_ready_err, 0, "fetch in handler failed");
+    zassert_within(m_data_ready_um, (ONE_METER_UM / 2), DISTANCE_TOLERANCE_UM,
+                   "wrong distance");
+
+    /* The fetch in the handler must not have started another measurement. */
+    zassert_not_equal(k_sem_take(&m_data_ready_sem, K_MSEC(TIMEOUT_MS)), 0,
+                      "DATA_READY raised again");
+    zassert_equal(hc_sr04_emul_trig_count(), (trig_count + 1), "TRIG not sent once");
+    zassert_equal(sensor_trigger_set(m_dev, &trig, NULL), 0, "trigger_set failed");
+}
+
+void test_main(void)
+{
+    m_dev = device_get_binding(DT_LABEL(DT_NODELABEL(us0)));
+    __ASSERT(NULL != m_dev, "HC-SR04 not found");
+
+    ztest_test_suite(hc_sr04_calc,
+                     ztest_unit_test(test_speed_to_scale),
+                     ztest_unit_test(test_count_bounds),
+                     ztest_unit_test(test_timer_count_wrap),
+                     ztest_unit_test(test_filter_median),
+                     ztest_unit_test(test_filter_window),
+                     ztest_unit_test(test_filter_ema),
+                     ztest_unit_test(test_velocity),
+                     ztest_unit_test(test_velocity_ring));
+
+    ztest_test_suite(hc_sr04_driver,
+                     ztest_unit_test_setup_teardown(test_valid_echo,
+                                                    sensor_idle_wait, unit_test_noop),
+                     ztest_unit_test_setup_teardown(test_invalid_pulse,
+                                                    sensor_idle_wait, unit_test_noop),
+                     ztest_unit_test_setup_teardown(test_spurious_pulse,
+                                                    sensor_idle_wait, unit_test_noop),
+                     ztest_unit_test_setup_teardown(test_no_response,
+                                                    sensor_idle_wait, unit_test_noop),
+                     ztest_unit_test_setup_teardown(test_sample_rate,
+                                                    sensor_idle_wait, unit_test_noop),
+                     ztest_unit_test_setup_teardown(test_data_ready,
+                                                    sensor_idle_wait, unit_test_noop));
+
+    ztest_run_test_suite(hc_sr04_calc);
+    ztest_run_test_suite(hc_sr04_driver);
+}